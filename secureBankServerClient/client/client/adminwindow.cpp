@@ -4,8 +4,8 @@
 const QRegularExpression AdminWindow::usernameRegex("^[a-zA-Z0-9_]*$");
 const QRegularExpression AdminWindow::passwordRegex("\\s");
 
-AdminWindow::AdminWindow(QWidget *parent, qint64 accountNumber, QSslSocket *socket)
-    : QMainWindow(parent), ui(new Ui::AdminWindow), socket(socket), accountNumber(accountNumber)
+AdminWindow::AdminWindow(QWidget *parent, qint64 accountNumber, RequestDispatcher *requestDispatcher)
+    : QMainWindow(parent), ui(new Ui::AdminWindow), requestDispatcher(requestDispatcher), accountNumber(accountNumber)
 {
     ui->setupUi(this);
     setWindowTitle("Admin Window - Account Number: " + QString::number(accountNumber));
@@ -13,7 +13,6 @@ AdminWindow::AdminWindow(QWidget *parent, qint64 accountNumber, QSslSocket *sock
     this->setWindowIconText("Admin");
     // Set the Qt::WA_DeleteOnClose attribute to ensure the destructor is called on close
     setAttribute(Qt::WA_DeleteOnClose);
-    connect(socket, &QSslSocket::readyRead, this, &AdminWindow::readyRead);
     qDebug() << "Constructed Admin Window.";
 }
 
@@ -25,58 +24,6 @@ AdminWindow::~AdminWindow()
     qDebug() << "Destroyed Admin Window.";
 }
 
-void AdminWindow::readyRead()
-{
-    // Read data from socket
-    QByteArray responseData = socket->readAll();
-
-    // Uncompress the response data
-    responseData = qUncompress(responseData);
-
-    // Try to parse the JSON document
-    QJsonDocument jsonResponse = QJsonDocument::fromJson(responseData);
-
-    // Check if the response is a valid JSON object
-    if (!jsonResponse.isObject())
-    {
-        qDebug() << "Invalid JSON response from the server.";
-        return;
-    }
-
-    // Handle the response based on the request ID
-    QJsonObject responseObject = jsonResponse.object();
-    int responseId = responseObject["responseId"].toInt();
-
-    switch (responseId)
-    {
-    case 1:
-        handleGetAccountNumberResponse(responseObject);
-        break;
-    case 2:
-        handleViewAccountBalanceResponse(responseObject);
-        break;
-    case 3:
-        handleCreateNewAccountResponse(responseObject);
-        break;
-    case 4:
-        handleDeleteAccountResponse(responseObject);
-        break;
-    case 5:
-        handleViewDatabaseResponse(responseObject);
-        break;
-    case 8:
-        handleViewTransactionHistoryResponse(responseObject);
-        break;
-    case 9:
-        handleUpdateAccountResponse(responseObject);
-        break;
-    default:
-        qDebug() << "Unknown responseId ID: " << responseId;
-        break;
-    }
-    // qDebug() << responseData;
-}
-
 void AdminWindow::on_pushButton_get_account_number_clicked()
 {
     // To ensure that iam connected to the server
@@ -111,11 +58,10 @@ void AdminWindow::on_pushButton_get_account_number_clicked()
     requestObject["requestId"] = static_cast<int>(requestId);
     requestObject["username"] = username;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
-
-    // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    // Send the request to the server, the reply is routed back by its correlation ID
+    requestDispatcher->sendRequest(requestObject, this,
+                                   [this](const QJsonObject &responseObject)
+                                   { handleGetAccountNumberResponse(responseObject); });
 }
 
 void AdminWindow::handleGetAccountNumberResponse(const QJsonObject &responseObject)
@@ -156,11 +102,10 @@ void AdminWindow::on_pbn_view_balance_clicked()
     requestObject["requestId"] = static_cast<int>(requestId);
     requestObject["accountNumber"] = accountNumber;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
-
-    // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    // Send the request to the server, the reply is routed back by its correlation ID
+    requestDispatcher->sendRequest(requestObject, this,
+                                   [this](const QJsonObject &responseObject)
+                                   { handleViewAccountBalanceResponse(responseObject); });
 }
 
 void AdminWindow::handleViewAccountBalanceResponse(const QJsonObject &responseObject)
@@ -249,11 +194,10 @@ void AdminWindow::on_pbn_create_new_account_clicked()
     requestObject["age"] = age;
     requestObject["isAdmin"] = isAdmin;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
-
-    // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    // Send the request to the server, the reply is routed back by its correlation ID
+    requestDispatcher->sendRequest(requestObject, this,
+                                   [this](const QJsonObject &responseObject)
+                                   { handleCreateNewAccountResponse(responseObject); });
 }
 
 void AdminWindow::handleCreateNewAccountResponse(const QJsonObject &responseObject)
@@ -307,11 +251,10 @@ void AdminWindow::on_pbn_delete_account_clicked()
         requestObject["requestId"] = static_cast<int>(requestId);
         requestObject["accountNumber"] = accountNumber;
 
-        // Convert the JSON object to a JSON document
-        QJsonDocument jsonRequest(requestObject);
-
-        // Send the request to the server
-        socket->write(jsonRequest.toJson());
+        // Send the request to the server, the reply is routed back by its correlation ID
+        requestDispatcher->sendRequest(requestObject, this,
+                                       [this](const QJsonObject &responseObject)
+                                       { handleDeleteAccountResponse(responseObject); });
     }
     else
     {
@@ -355,11 +298,10 @@ void AdminWindow::on_pbn_view_database_clicked()
     QJsonObject requestObject;
     requestObject["requestId"] = static_cast<int>(requestId);
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
-
-    // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    // Send the request to the server, the reply is routed back by its correlation ID
+    requestDispatcher->sendRequest(requestObject, this,
+                                   [this](const QJsonObject &responseObject)
+                                   { handleViewDatabaseResponse(responseObject); });
 }
 
 void AdminWindow::handleViewDatabaseResponse(const QJsonObject &responseObject)
@@ -437,11 +379,10 @@ void AdminWindow::on_pbn_view_transaction_history_clicked()
     requestObject["requestId"] = static_cast<int>(requestId);
     requestObject["accountNumber"] = accountNumber;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
-
-    // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    // Send the request to the server, the reply is routed back by its correlation ID
+    requestDispatcher->sendRequest(requestObject, this,
+                                   [this](const QJsonObject &responseObject)
+                                   { handleViewTransactionHistoryResponse(responseObject); });
 }
 
 void AdminWindow::handleViewTransactionHistoryResponse(const QJsonObject &responseObject)
@@ -540,11 +481,10 @@ void AdminWindow::on_pbn_update_account_clicked()
     if (!name.isEmpty())
         requestObject["name"] = name;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
-
-    // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    // Send the request to the server, the reply is routed back by its correlation ID
+    requestDispatcher->sendRequest(requestObject, this,
+                                   [this](const QJsonObject &responseObject)
+                                   { handleUpdateAccountResponse(responseObject); });
 }
 
 void AdminWindow::handleUpdateAccountResponse(const QJsonObject &responseObject)
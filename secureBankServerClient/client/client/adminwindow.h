@@ -15,7 +15,7 @@ class AdminWindow : public QMainWindow
 public:
     explicit AdminWindow(QWidget *parent = nullptr,
                          qint64 accountNumber = 0,
-                         QSslSocket *socket = nullptr);
+                         RequestDispatcher *requestDispatcher = nullptr);
     ~AdminWindow();
 
 signals:
@@ -23,7 +23,6 @@ signals:
     void finished();
 
 private slots:
-    void readyRead();
     void on_pushButton_get_account_number_clicked();
     void on_pbn_view_balance_clicked();
     void on_pbn_create_new_account_clicked();
@@ -34,7 +33,7 @@ private slots:
 
 private:
     Ui::AdminWindow *ui;
-    QSslSocket *socket;
+    RequestDispatcher *requestDispatcher;
     qint64 accountNumber;
 
     // Regular expressions for username and password validation
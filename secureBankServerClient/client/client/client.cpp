@@ -10,7 +10,9 @@ const QRegularExpression client::passwordRegex("\\s");
 client::client(QWidget *parent)
     : QMainWindow(parent),
       ui(new Ui::client),
-      socket(new QSslSocket(this))
+      socket(new QSslSocket(this)),
+      messageFramer(new MessageFramer(socket, this)),
+      requestDispatcher(new RequestDispatcher(messageFramer, this))
 {
     // Setup the UI
     ui->setupUi(this);
@@ -32,13 +34,19 @@ client::client(QWidget *parent)
     caCerts.append(cert);
     QSslConfiguration sslConfig = socket->sslConfiguration();
     sslConfig.setCaCertificates(caCerts);
+    // Keep the session so a reconnect after an idle disconnect can resume it
+    sslConfig.setSslOption(QSsl::SslOptionDisableSessionPersistence, false);
+    sslConfig.setSslOption(QSsl::SslOptionDisableSessionTickets, false);
     socket->setSslConfiguration(sslConfig);
 
     // handle state changed for connection
     connect(socket, &QSslSocket::stateChanged, this, &client::handleStateChanged);
 
-    // Connect the readyRead signal to the readyRead slot
-    connect(socket, &QSslSocket::readyRead, this, &client::readyRead);
+    // Negotiate the binary encoding once the connection is secured
+    connect(socket, &QSslSocket::encrypted, this, &client::handleEncrypted);
+
+    // TLS 1.3 servers send their session tickets after the handshake
+    connect(socket, &QSslSocket::newSessionTicketReceived, this, &client::storeSessionTicket);
 
     // Connect the sslErrors signal to the handleSslErrors slot
     connect(socket, QOverload<const QList<QSslError>&>::of(&QSslSocket::sslErrors),
@@ -65,6 +73,17 @@ void client::connectToServer()
     // Get the IP address from the line edit
     QString ipAddress = ui->lineEdit_ip->text();
 
+    // A new connection starts a new stream, drop any half received frame
+    // and the requests that were waiting for a reply on the old one
+    messageFramer->reset();
+    requestDispatcher->resetConnection();
+
+    // Offer the last session, a server that still knows it can skip the full handshake
+    QSslConfiguration sslConfig = socket->sslConfiguration();
+    sslConfig.setSessionTicket(sessionHost == ipAddress ? sessionTicket : QByteArray());
+    socket->setSslConfiguration(sslConfig);
+    sessionHost = ipAddress;
+
     // Attempt to connect to the server encrypted
     socket->connectToHostEncrypted(ipAddress, 19908);
 }
@@ -99,6 +118,12 @@ void client::handleStateChanged(QAbstractSocket::SocketState socketState)
     }
     else
     {
+        // No heartbeats or replies without a connection
+        if (socketState == QAbstractSocket::UnconnectedState)
+        {
+            requestDispatcher->resetConnection();
+        }
+
         // The socket is not connected
         ui->chkbox->setText("Not connected");
         ui->chkbox->setChecked(false);
@@ -114,43 +139,27 @@ void client::handleSslErrors(const QList<QSslError> &errors)
     }
 }
 
-void client::on_pbn_connect_clicked()
+void client::handleEncrypted()
 {
-    connectToServer();
+    storeSessionTicket();
+
+    // CBOR replies are smaller and cheaper to parse than JSON text,
+    // the server only compresses the replies that are worth it
+    requestDispatcher->negotiateProtocol(MessageCodec::Cbor, true);
 }
 
-// Slot for handling incoming data from the server
-void client::readyRead()
+void client::storeSessionTicket()
 {
-    // Read data from socket
-    QByteArray responseData = socket->readAll();
-
-    // Uncompress the response data
-    responseData = qUncompress(responseData);
-
-    // Try to parse the JSON document
-    QJsonDocument jsonResponse = QJsonDocument::fromJson(responseData);
-
-    // Check if the response is a valid JSON object
-    if (!jsonResponse.isObject())
+    QByteArray ticket = socket->sslConfiguration().sessionTicket();
+    if (!ticket.isEmpty())
     {
-        qDebug() << "Invalid JSON response from the server.";
-        return;
+        sessionTicket = ticket;
     }
+}
 
-    // Handle the response based on the request ID
-    QJsonObject responseObject = jsonResponse.object();
-    int responseId = responseObject["responseId"].toInt();
-
-    switch (responseId)
-    {
-    case 0:
-        handleLoginResponse(responseObject);
-        break;
-    default:
-        qDebug() << "Unknown responseId ID: " << responseId;
-        break;
-    }
+void client::on_pbn_connect_clicked()
+{
+    connectToServer();
 }
 
 // Slot for handling login button click
@@ -192,11 +201,10 @@ void client::on_pushButton_login_clicked()
     requestObject["username"] = username;
     requestObject["password"] = password;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
-
-    // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    // Send the request to the server, the reply is routed back by its correlation ID
+    requestDispatcher->sendRequest(requestObject, this,
+                                   [this](const QJsonObject &responseObject)
+                                   { handleLoginResponse(responseObject); });
 }
 
 // Function to handle login response from the server
@@ -213,9 +221,7 @@ void client::handleLoginResponse(const QJsonObject &responseObject)
         // Create and show the appropriate window based on user type
         if (isAdmin)
         {
-            // Disconnect the readyRead signal from the client slot
-            disconnect(socket, &QSslSocket::readyRead, this, &client::readyRead);
-            AdminWindow *adminWindow = new AdminWindow(nullptr, accountNumber, socket);
+            AdminWindow *adminWindow = new AdminWindow(nullptr, accountNumber, requestDispatcher);
 
             // Connect the finished signal in the AdminWindow object to showOldWindow in the client object
             connect(adminWindow, &AdminWindow::finished,
@@ -230,9 +236,7 @@ void client::handleLoginResponse(const QJsonObject &responseObject)
         }
         else
         {
-            // Disconnect the readyRead signal from the client slot
-            disconnect(socket, &QSslSocket::readyRead, this, &client::readyRead);
-            UserWindow *userWindow = new UserWindow(nullptr, accountNumber, socket);
+            UserWindow *userWindow = new UserWindow(nullptr, accountNumber, requestDispatcher);
 
             // Connect the finished signal in the UserWindow object to showOldWindow in the client object
             connect(userWindow, &UserWindow::finished,
@@ -256,7 +260,6 @@ void client::handleLoginResponse(const QJsonObject &responseObject)
 
 void client::showOldWindow()
 {
-    connect(socket, &QSslSocket::readyRead, this, &client::readyRead);
     // Clear the login window
     ui->lineEdit_Username->clear();
     ui->lineEdit_Password->clear();
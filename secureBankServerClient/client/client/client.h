@@ -14,6 +14,8 @@
 #include <QFile>
 #include <QDebug>
 
+#include "requestdispatcher.h"
+
 namespace Ui
 {
     class client;
@@ -30,17 +32,24 @@ public:
 public slots:
     void ensureConnected();
     void showOldWindow();
-    void readyRead();
 
 private slots:
     void on_pushButton_login_clicked();
     void on_pbn_connect_clicked();
     void handleStateChanged(QAbstractSocket::SocketState socketState);
     void handleSslErrors(const QList<QSslError> &errors);
+    void handleEncrypted();
+    void storeSessionTicket();
 
 private:
     Ui::client *ui;
     QSslSocket *socket;
+    MessageFramer *messageFramer;
+    RequestDispatcher *requestDispatcher;
+
+    // Last TLS session with sessionHost, offered again on the next connection
+    QByteArray sessionTicket;
+    QString sessionHost;
 
     // Regular expressions for username and password validation
     static const QRegularExpression usernameRegex;
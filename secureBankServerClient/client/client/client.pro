@@ -12,11 +12,17 @@ SOURCES += \
     adminwindow.cpp \
     main.cpp \
     client.cpp \
+    messagecodec.cpp \
+    messageframer.cpp \
+    requestdispatcher.cpp \
     userwindow.cpp
 
 HEADERS += \
     adminwindow.h \
     client.h \
+    messagecodec.h \
+    messageframer.h \
+    requestdispatcher.h \
     userwindow.h
 
 FORMS += \
@@ -0,0 +1,298 @@
+#include "messagecodec.h"
+
+// JSON only allows these four characters as insignificant whitespace
+static bool isJsonWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Writes value straight into the CBOR stream, without building a QCborValue first.
+// Integral numbers are written as CBOR integers, like QCborValue::fromJsonValue does.
+static void writeCborValue(QCborStreamWriter &writer, const QJsonValue &value)
+{
+    switch (value.type())
+    {
+    case QJsonValue::Bool:
+        writer.append(value.toBool());
+        break;
+    case QJsonValue::Double:
+    {
+        double number = value.toDouble();
+        qint64 integer = value.toInteger();
+        if (static_cast<double>(integer) == number)
+        {
+            writer.append(integer);
+        }
+        else
+        {
+            writer.append(number);
+        }
+        break;
+    }
+    case QJsonValue::String:
+        writer.append(value.toString());
+        break;
+    case QJsonValue::Array:
+    {
+        const QJsonArray array = value.toArray();
+        writer.startArray(static_cast<quint64>(array.size()));
+        for (const QJsonValue &element : array)
+        {
+            writeCborValue(writer, element);
+        }
+        writer.endArray();
+        break;
+    }
+    case QJsonValue::Object:
+    {
+        const QJsonObject object = value.toObject();
+        writer.startMap(static_cast<quint64>(object.size()));
+        for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it)
+        {
+            writer.append(it.key());
+            writeCborValue(writer, it.value());
+        }
+        writer.endMap();
+        break;
+    }
+    default:
+        writer.append(nullptr);
+        break;
+    }
+}
+
+static QByteArray encodeCbor(const QJsonObject &object)
+{
+    QByteArray data;
+    QCborStreamWriter writer(&data);
+    writeCborValue(writer, object);
+    return data;
+}
+
+// Text strings may arrive in chunks
+static bool readCborString(QCborStreamReader &reader, QString *string)
+{
+    string->clear();
+    QCborStreamReader::StringResult<QString> chunk = reader.readString();
+    while (chunk.status == QCborStreamReader::Ok)
+    {
+        string->append(chunk.data);
+        chunk = reader.readString();
+    }
+    return chunk.status == QCborStreamReader::EndOfString;
+}
+
+// Nesting allowed in a received message, the same bound Qt's own parsers use.
+// Messages come from the network, deeper data must not exhaust the stack.
+#define CBOR_MAX_DEPTH 1024
+
+// Reads the value at the reader's position straight into a QJsonValue
+static bool readCborValue(QCborStreamReader &reader, QJsonValue *value, int depth)
+{
+    if (depth > CBOR_MAX_DEPTH)
+    {
+        return false;
+    }
+
+    switch (reader.type())
+    {
+    case QCborStreamReader::UnsignedInteger:
+    case QCborStreamReader::NegativeInteger:
+        *value = reader.toInteger();
+        return reader.next();
+    case QCborStreamReader::Float16:
+        *value = static_cast<double>(reader.toFloat16());
+        return reader.next();
+    case QCborStreamReader::Float:
+        *value = static_cast<double>(reader.toFloat());
+        return reader.next();
+    case QCborStreamReader::Double:
+        *value = reader.toDouble();
+        return reader.next();
+    case QCborStreamReader::SimpleType:
+        if (reader.isFalse() || reader.isTrue())
+        {
+            *value = reader.toBool();
+        }
+        else
+        {
+            *value = QJsonValue(QJsonValue::Null);
+        }
+        return reader.next();
+    case QCborStreamReader::String:
+    {
+        QString string;
+        if (!readCborString(reader, &string))
+        {
+            return false;
+        }
+        *value = string;
+        return true;
+    }
+    case QCborStreamReader::Tag:
+        // Tags only annotate the value that follows
+        return reader.next() && readCborValue(reader, value, depth + 1);
+    case QCborStreamReader::Array:
+    {
+        QJsonArray array;
+        if (!reader.enterContainer())
+        {
+            return false;
+        }
+        while (reader.hasNext())
+        {
+            QJsonValue element;
+            if (!readCborValue(reader, &element, depth + 1))
+            {
+                return false;
+            }
+            array.append(element);
+        }
+        *value = array;
+        return reader.leaveContainer();
+    }
+    case QCborStreamReader::Map:
+    {
+        QJsonObject object;
+        if (!reader.enterContainer())
+        {
+            return false;
+        }
+        while (reader.hasNext())
+        {
+            // Only text keys are part of the protocol
+            QString key;
+            if (!reader.isString() || !readCborString(reader, &key))
+            {
+                return false;
+            }
+            QJsonValue element;
+            if (!readCborValue(reader, &element, depth + 1))
+            {
+                return false;
+            }
+            object.insert(key, element);
+        }
+        *value = object;
+        return reader.leaveContainer();
+    }
+    default:
+        // Byte strings, undefined and invalid data never appear in a message
+        return false;
+    }
+}
+
+static bool decodeCbor(const QByteArray &data, QJsonObject *object)
+{
+    QCborStreamReader reader(data);
+    QJsonValue value;
+    if (!reader.isMap() || !readCborValue(reader, &value, 0) ||
+        reader.lastError() != QCborError::NoError)
+    {
+        return false;
+    }
+    // A frame carries exactly one message
+    if (reader.currentOffset() != data.size())
+    {
+        return false;
+    }
+    *object = value.toObject();
+    return true;
+}
+
+MessageCodec::MessageCodec()
+{}
+
+MessageCodec::Encoding MessageCodec::encoding() const
+{
+    return currentEncoding;
+}
+
+void MessageCodec::setEncoding(Encoding encoding)
+{
+    currentEncoding = encoding;
+}
+
+QByteArray MessageCodec::encodeRequest(const QJsonObject &requestObject) const
+{
+    if (currentEncoding == Cbor)
+    {
+        return encodeCbor(requestObject);
+    }
+    return QJsonDocument(requestObject).toJson(QJsonDocument::Compact);
+}
+
+QJsonObject MessageCodec::decodeResponse(const QByteArray &message, bool *ok) const
+{
+    *ok = false;
+
+    if (message.isEmpty())
+    {
+        return QJsonObject();
+    }
+
+    // Small responses are sent as they are, only uncompress when the server says so
+    quint8 flags = static_cast<quint8>(message.at(0));
+    QByteArray responseData;
+    if (flags & Compressed)
+    {
+        responseData = qUncompress(reinterpret_cast<const uchar *>(message.constData()) + 1,
+                                   message.size() - 1);
+    }
+    else
+    {
+        // Parse in place behind the flag byte without copying the payload
+        responseData = QByteArray::fromRawData(message.constData() + 1, message.size() - 1);
+    }
+
+    // Skip leading whitespace so indented JSON is detected too
+    qsizetype start = 0;
+    while (start < responseData.size() && isJsonWhitespace(responseData.at(start)))
+    {
+        ++start;
+    }
+    if (start == responseData.size())
+    {
+        return QJsonObject();
+    }
+
+    if (responseData.at(start) == '{')
+    {
+        // Try to parse the JSON document
+        QJsonDocument jsonResponse = QJsonDocument::fromJson(responseData);
+        if (!jsonResponse.isObject())
+        {
+            return QJsonObject();
+        }
+        *ok = true;
+        return jsonResponse.object();
+    }
+
+    QJsonObject responseObject;
+    if (!decodeCbor(responseData, &responseObject))
+    {
+        return QJsonObject();
+    }
+    *ok = true;
+    return responseObject;
+}
+
+bool MessageCodec::encodingFromName(const QString &name, Encoding *encoding)
+{
+    if (name.compare("json", Qt::CaseInsensitive) == 0)
+    {
+        *encoding = Json;
+        return true;
+    }
+    if (name.compare("cbor", Qt::CaseInsensitive) == 0)
+    {
+        *encoding = Cbor;
+        return true;
+    }
+    return false;
+}
+
+QString MessageCodec::encodingName(Encoding encoding)
+{
+    return encoding == Cbor ? "cbor" : "json";
+}
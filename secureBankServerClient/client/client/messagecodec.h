@@ -0,0 +1,50 @@
+#ifndef MESSAGECODEC_H
+#define MESSAGECODEC_H
+
+#include <QByteArray>
+#include <QString>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QCborStreamReader>
+#include <QCborStreamWriter>
+
+// Request ID used to pick the encoding of the connection
+#define NEGOTIATE_PROTOCOL_REQUEST 10
+// Keeps an otherwise quiet connection open, answered without touching the database
+#define HEARTBEAT_REQUEST 11
+
+// Encodes requests and decodes responses for the connection to the server.
+// Responses are decoded by looking at them, JSON text always starts with '{'
+// while a CBOR map never does, so no reply is misread around a negotiation.
+// Every response starts with a flag byte telling whether the rest is compressed.
+class MessageCodec
+{
+public:
+    enum Encoding
+    {
+        Json,
+        Cbor
+    };
+
+    enum ResponseFlag
+    {
+        Compressed = 0x01
+    };
+
+    MessageCodec();
+
+    Encoding encoding() const;
+    void setEncoding(Encoding encoding);
+
+    QByteArray encodeRequest(const QJsonObject &requestObject) const;
+    QJsonObject decodeResponse(const QByteArray &message, bool *ok) const;
+
+    static bool encodingFromName(const QString &name, Encoding *encoding);
+    static QString encodingName(Encoding encoding);
+
+private:
+    Encoding currentEncoding = Json;
+};
+
+#endif // MESSAGECODEC_H
@@ -0,0 +1,81 @@
+#include "messageframer.h"
+
+MessageFramer::MessageFramer(QIODevice *device, QObject *parent)
+    : QObject(parent), device(device)
+{
+    connect(device, &QIODevice::readyRead, this, &MessageFramer::readyRead);
+}
+
+MessageFramer::~MessageFramer()
+{}
+
+bool MessageFramer::sendMessage(const QByteArray &message)
+{
+    char header[FRAME_HEADER_SIZE];
+    qToBigEndian<quint32>(static_cast<quint32>(message.size()), header);
+
+    // The device buffers writes itself so the header and payload are not joined here
+    if (device->write(header, FRAME_HEADER_SIZE) != FRAME_HEADER_SIZE)
+    {
+        return false;
+    }
+    return device->write(message) == message.size();
+}
+
+void MessageFramer::reset()
+{
+    buffer.resize(0);
+    readOffset = 0;
+}
+
+void MessageFramer::readyRead()
+{
+    qint64 available = device->bytesAvailable();
+    if (available <= 0)
+    {
+        return;
+    }
+
+    // Read straight into the tail of the reassembly buffer
+    qsizetype oldSize = buffer.size();
+    buffer.resize(oldSize + available);
+    qint64 bytesRead = device->read(buffer.data() + oldSize, available);
+    if (bytesRead < 0)
+    {
+        buffer.resize(oldSize);
+        emit framingError("Failed to read from device: " + device->errorString());
+        return;
+    }
+    buffer.resize(oldSize + bytesRead);
+
+    // Hand out every complete frame, a read may hold several or only part of one
+    while (buffer.size() - readOffset >= FRAME_HEADER_SIZE)
+    {
+        quint32 payloadSize = qFromBigEndian<quint32>(buffer.constData() + readOffset);
+        if (payloadSize > MAX_FRAME_SIZE)
+        {
+            reset();
+            emit framingError(QString("Frame of %1 bytes exceeds the limit.").arg(payloadSize));
+            return;
+        }
+        if (buffer.size() - readOffset - FRAME_HEADER_SIZE < payloadSize)
+        {
+            break;
+        }
+
+        QByteArray message = buffer.mid(readOffset + FRAME_HEADER_SIZE, payloadSize);
+        readOffset += FRAME_HEADER_SIZE + payloadSize;
+        emit messageReceived(message);
+    }
+
+    // Reuse the buffer once it is drained, compact it when the consumed prefix dominates
+    if (readOffset >= buffer.size())
+    {
+        reset();
+    }
+    else if (readOffset > buffer.size() / 2)
+    {
+        buffer.remove(0, readOffset);
+        readOffset = 0;
+    }
+}
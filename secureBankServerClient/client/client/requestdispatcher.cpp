@@ -0,0 +1,130 @@
+#include "requestdispatcher.h"
+
+RequestDispatcher::RequestDispatcher(MessageFramer *messageFramer, QObject *parent)
+    : QObject(parent), messageFramer(messageFramer)
+{
+    connect(messageFramer, &MessageFramer::messageReceived,
+            this, &RequestDispatcher::handleMessage);
+
+    // Started with the interval the server asks for during negotiation
+    heartbeatTimer = new QTimer(this);
+    connect(heartbeatTimer, &QTimer::timeout, this, &RequestDispatcher::sendHeartbeat);
+}
+
+RequestDispatcher::~RequestDispatcher()
+{}
+
+quint32 RequestDispatcher::sendRequest(QJsonObject requestObject, QObject *receiver,
+                                       ResponseHandler handler)
+{
+    quint32 correlationId = nextCorrelationId++;
+    // Zero is never used so a missing id in a reply can not match a request
+    if (nextCorrelationId == 0)
+    {
+        nextCorrelationId = 1;
+    }
+
+    requestObject["correlationId"] = static_cast<qint64>(correlationId);
+    pendingRequests.insert(correlationId, PendingRequest{receiver, std::move(handler)});
+
+    // Any request keeps the connection open just as well, the next heartbeat is due
+    // one full interval after the last frame sent
+    if (heartbeatTimer->isActive())
+    {
+        heartbeatTimer->start();
+    }
+
+    // Send the request to the server in the negotiated encoding
+    if (!messageFramer->sendMessage(messageCodec.encodeRequest(requestObject)))
+    {
+        qDebug() << "Failed to send request with correlation ID: " << correlationId;
+    }
+    return correlationId;
+}
+
+void RequestDispatcher::negotiateProtocol(MessageCodec::Encoding encoding, bool compression)
+{
+    QJsonObject requestObject;
+    requestObject["requestId"] = NEGOTIATE_PROTOCOL_REQUEST;
+    requestObject["encoding"] = MessageCodec::encodingName(encoding);
+    requestObject["compression"] = compression;
+
+    sendRequest(requestObject, this,
+                [this](const QJsonObject &responseObject)
+                {
+                    MessageCodec::Encoding negotiated;
+                    if (responseObject["negotiateSuccess"].toBool() &&
+                        MessageCodec::encodingFromName(responseObject["encoding"].toString(),
+                                                       &negotiated))
+                    {
+                        messageCodec.setEncoding(negotiated);
+                        qDebug() << "Negotiated encoding: " << MessageCodec::encodingName(negotiated)
+                                 << " compression: " << responseObject["compression"].toBool();
+                    }
+                    else
+                    {
+                        qDebug() << "Server refused encoding, staying on: "
+                                 << MessageCodec::encodingName(messageCodec.encoding());
+                    }
+
+                    // Older servers ask for no heartbeat
+                    int heartbeatIntervalMs = responseObject["heartbeatIntervalMs"].toInt();
+                    if (heartbeatIntervalMs > 0)
+                    {
+                        heartbeatTimer->start(heartbeatIntervalMs);
+                    }
+                });
+}
+
+void RequestDispatcher::resetConnection()
+{
+    heartbeatTimer->stop();
+    pendingRequests.clear();
+    messageCodec.setEncoding(MessageCodec::Json);
+}
+
+int RequestDispatcher::pendingRequestCount() const
+{
+    return pendingRequests.size();
+}
+
+void RequestDispatcher::handleMessage(const QByteArray &message)
+{
+    bool decoded;
+    QJsonObject responseObject = messageCodec.decodeResponse(message, &decoded);
+
+    // Check if the response is a valid object
+    if (!decoded)
+    {
+        qDebug() << "Invalid response from the server.";
+        return;
+    }
+
+    // Route the response to the handler waiting for its correlation ID
+    quint32 correlationId = static_cast<quint32>(
+        responseObject["correlationId"].toVariant().toLongLong());
+
+    auto it = pendingRequests.find(correlationId);
+    if (it == pendingRequests.end())
+    {
+        qDebug() << "Unexpected response with correlation ID: " << correlationId;
+        return;
+    }
+    PendingRequest pendingRequest = std::move(it.value());
+    pendingRequests.erase(it);
+
+    // The window that sent the request may have been closed meanwhile
+    if (pendingRequest.receiver.isNull())
+    {
+        return;
+    }
+    pendingRequest.handler(responseObject);
+}
+
+void RequestDispatcher::sendHeartbeat()
+{
+    // Only fires after a full interval without any other request
+    QJsonObject requestObject;
+    requestObject["requestId"] = HEARTBEAT_REQUEST;
+    sendRequest(requestObject, this, [](const QJsonObject &) {});
+}
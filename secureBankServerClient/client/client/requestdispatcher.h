@@ -0,0 +1,59 @@
+#ifndef REQUESTDISPATCHER_H
+#define REQUESTDISPATCHER_H
+
+#include <QObject>
+#include <QHash>
+#include <QPointer>
+#include <QTimer>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QDebug>
+#include <functional>
+
+#include "messageframer.h"
+#include "messagecodec.h"
+
+// Sends requests tagged with a correlation id and routes every reply back to the
+// handler registered for that id, so any number of requests can be in flight at once
+class RequestDispatcher : public QObject
+{
+    Q_OBJECT
+
+public:
+    using ResponseHandler = std::function<void(const QJsonObject &responseObject)>;
+
+    RequestDispatcher(MessageFramer *messageFramer, QObject *parent = nullptr);
+    ~RequestDispatcher();
+
+    // The handler is dropped without being called if receiver is destroyed first
+    quint32 sendRequest(QJsonObject requestObject, QObject *receiver,
+                        ResponseHandler handler);
+    // Ask the server to switch this connection to another encoding and to turn
+    // response compression on or off, requests keep the current encoding until the server agrees
+    void negotiateProtocol(MessageCodec::Encoding encoding, bool compression);
+    // Forget every outstanding request, their replies can not arrive on a new connection,
+    // and fall back to JSON until the new connection is negotiated
+    void resetConnection();
+    int pendingRequestCount() const;
+
+private slots:
+    void handleMessage(const QByteArray &message);
+    void sendHeartbeat();
+
+private:
+    struct PendingRequest
+    {
+        QPointer<QObject> receiver;
+        ResponseHandler handler;
+    };
+
+    MessageFramer *messageFramer;
+    MessageCodec messageCodec;
+    QHash<quint32, PendingRequest> pendingRequests;
+    quint32 nextCorrelationId = 1;
+    // Keeps the connection open while the user is not sending anything,
+    // restarted by every request so it only fires after a quiet interval
+    QTimer *heartbeatTimer;
+};
+
+#endif // REQUESTDISPATCHER_H
@@ -1,15 +1,14 @@
 #include "userwindow.h"
 #include "ui_userwindow.h"
 
-UserWindow::UserWindow(QWidget *parent, qint64 accountNumber, QSslSocket *socket)
-    : QMainWindow(parent), ui(new Ui::UserWindow), socket(socket), accountNumber(accountNumber)
+UserWindow::UserWindow(QWidget *parent, qint64 accountNumber, RequestDispatcher *requestDispatcher)
+    : QMainWindow(parent), ui(new Ui::UserWindow), requestDispatcher(requestDispatcher), accountNumber(accountNumber)
 {
     ui->setupUi(this);
     setWindowTitle("User Window - Account Number: " + QString::number(accountNumber));
     this->setWindowIcon(QIcon("bank.jpg"));
     this->setWindowIconText("Admin");
     setAttribute(Qt::WA_DeleteOnClose);
-    connect(socket, &QSslSocket::readyRead, this, &UserWindow::readyRead);
     qDebug() << "Constructed User Window.";
 }
 
@@ -20,49 +19,6 @@ UserWindow::~UserWindow()
     qDebug() << "Destroyed User Window.";
 }
 
-void UserWindow::readyRead()
-{
-    // Read data from socket
-    QByteArray responseData = socket->readAll();
-
-    // Uncompress the response data
-    responseData = qUncompress(responseData);
-
-    // Try to parse the JSON document
-    QJsonDocument jsonResponse = QJsonDocument::fromJson(responseData);
-
-    // Check if the response is a valid JSON object
-    if (!jsonResponse.isObject())
-    {
-        qDebug() << "Invalid JSON response from the server.";
-        return;
-    }
-
-    QJsonObject responseObject = jsonResponse.object();
-    int responseId = responseObject["responseId"].toInt();
-
-    switch (responseId)
-    {
-    case 1:
-        break;
-    case 2:
-        handleViewAccountBalanceResponse(responseObject);
-        break;
-    case 6:
-        handleMakeTransactionResponse(responseObject);
-        break;
-    case 7:
-        handleMakeTransferResponse(responseObject);
-        break;
-    case 8:
-        handleViewTransactionHistoryResponse(responseObject);
-        break;
-    default:
-        qDebug() << "Unknown responseId ID: " << responseId;
-        break;
-    }
-}
-
 void UserWindow::on_pushButton_get_account_number_clicked()
 {
     ui->label_account_number->setText("Account Number: " + QString::number(accountNumber));
@@ -82,11 +38,10 @@ void UserWindow::on_pbn_view_balance_clicked()
     requestObject["requestId"] = static_cast<int>(requestId);
     requestObject["accountNumber"] = accountNumber;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
-
-    // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    // Send the request to the server, the reply is routed back by its correlation ID
+    requestDispatcher->sendRequest(requestObject, this,
+                                   [this](const QJsonObject &responseObject)
+                                   { handleViewAccountBalanceResponse(responseObject); });
 }
 
 void UserWindow::handleViewAccountBalanceResponse(const QJsonObject &responseObject)
@@ -139,12 +94,10 @@ void UserWindow::on_pbn_make_trasnaction_clicked()
     transactionRequest["accountNumber"] = accountNumber;
     transactionRequest["amount"] = amount;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(transactionRequest);
-
-    // Send the request to the server
-    socket->write(jsonRequest.toJson());
-    socket->flush();
+    // Send the request to the server, the reply is routed back by its correlation ID
+    requestDispatcher->sendRequest(transactionRequest, this,
+                                   [this](const QJsonObject &responseObject)
+                                   { handleMakeTransactionResponse(responseObject); });
 }
 
 void UserWindow::handleMakeTransactionResponse(const QJsonObject &responseObject)
@@ -218,12 +171,10 @@ void UserWindow::on_pbn_mk_transfer_clicked()
     transferRequest["toAccountNumber"] = toAccountNumber;
     transferRequest["amount"] = amount;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(transferRequest);
-
-    // Send the request to the server
-    socket->write(jsonRequest.toJson());
-    socket->flush();
+    // Send the request to the server, the reply is routed back by its correlation ID
+    requestDispatcher->sendRequest(transferRequest, this,
+                                   [this](const QJsonObject &responseObject)
+                                   { handleMakeTransferResponse(responseObject); });
 }
 
 void UserWindow::handleMakeTransferResponse(const QJsonObject &responseObject)
@@ -264,11 +215,10 @@ void UserWindow::on_pbn_view_transaction_histroy_clicked()
     requestObject["requestId"] = static_cast<int>(requestId);
     requestObject["accountNumber"] = accountNumber;
 
-    // Convert the JSON object to a JSON document
-    QJsonDocument jsonRequest(requestObject);
-
-    // Send the request to the server
-    socket->write(jsonRequest.toJson());
+    // Send the request to the server, the reply is routed back by its correlation ID
+    requestDispatcher->sendRequest(requestObject, this,
+                                   [this](const QJsonObject &responseObject)
+                                   { handleViewTransactionHistoryResponse(responseObject); });
 }
 
 void UserWindow::handleViewTransactionHistoryResponse(const QJsonObject &responseObject)
@@ -15,7 +15,7 @@ class UserWindow : public QMainWindow
 public:
     explicit UserWindow(QWidget *parent = nullptr,
                         qint64 accountNumber = 0,
-                        QSslSocket *socket = nullptr);
+                        RequestDispatcher *requestDispatcher = nullptr);
     ~UserWindow();
 
 signals:
@@ -23,7 +23,6 @@ signals:
     void finished();
 
 private slots:
-    void readyRead();
 
     void on_pushButton_get_account_number_clicked();
 
@@ -37,7 +36,7 @@ private slots:
 
 private:
     Ui::UserWindow *ui;
-    QSslSocket *socket;
+    RequestDispatcher *requestDispatcher;
     qint64 accountNumber;
 
     void handleViewAccountBalanceResponse(const QJsonObject &responseObject);
@@ -4,6 +4,8 @@
 #include <QObject>
 
 #include "DatabaseManager.h"
+#include "Money.h"
+#include "BalanceCache.h"
 #include "Logger.h"
 
 class TransactionManager : public QObject
@@ -14,15 +16,23 @@ public:
     TransactionManager(DatabaseManager* databaseManager, QObject *parent = nullptr);
     ~TransactionManager();
 
+    // Connection used by the following calls, leased per request by the caller
+    void setDatabaseManager(DatabaseManager* databaseManager);
+
     // Functions related to transaction management
     QJsonObject makeTransaction(QJsonObject requestJson);
     QJsonObject makeTransfer(QJsonObject requestJson);
     QJsonObject viewTransactionHistory(QJsonObject requestJson);
 
     // Helper Function for logging transaction
-    bool logTransaction(qint64 accountNumber, double amount);
+    bool logTransaction(qint64 accountNumber, const Money &amount, const QDateTime &transactionTime);
 
 private:
+    // Adds amount to the balance unless that would make it negative.
+    // Returns false on a database error, applied is false when no row was updated.
+    bool adjustBalance(qint64 accountNumber, const Money &amount, bool *applied, Money *newBalance);
+    bool accountExists(qint64 accountNumber);
+
     QString connectionName;
     DatabaseManager* databaseManager = nullptr;
     Logger logger;
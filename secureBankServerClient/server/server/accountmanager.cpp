@@ -3,48 +3,122 @@
 AccountManager::AccountManager(DatabaseManager* databaseManager, QObject *parent)
     : QObject(parent), databaseManager(databaseManager), logger("AccountManager")
 {
-    logger.log("AccountManager Object Created.");
+    LOG_DEBUG(logger, "AccountManager Object Created.");
 }
 
 AccountManager::~AccountManager()
 {
-    logger.log("AccountManager Object Destroyed");
+    LOG_DEBUG(logger, "AccountManager Object Destroyed");
+}
+
+void AccountManager::setDatabaseManager(DatabaseManager* databaseManager)
+{
+    this->databaseManager = databaseManager;
 }
 
 QJsonObject AccountManager::login(QJsonObject requestJson)
 {
-    QJsonObject responseJson;
-    responseJson["loginSuccess"] = false;
+    // Everything on the calling thread, connections go through the hashing pool instead
+    LoginAttempt attempt = lookupLogin(requestJson);
+    verifyLogin(&attempt);
+    return finishLogin(attempt);
+}
 
+AccountManager::LoginAttempt AccountManager::lookupLogin(const QJsonObject &requestJson)
+{
     // Extract the username and password from the request JSON
-    QString username = requestJson["username"].toString();
-    QString password = requestJson["password"].toString();
+    LoginAttempt attempt;
+    attempt.username = requestJson["username"].toString();
+    attempt.password = requestJson["password"].toString();
+
+    // Users reconnecting after an idle disconnect are verified from memory
+    if (LoginCache::instance()->authenticate(attempt.username, attempt.password, &attempt.principal))
+    {
+        attempt.accountFound = true;
+        attempt.cached = true;
+        attempt.verified = true;
+        return attempt;
+    }
 
     // Prepare the search criteria
     QJsonObject searchCriteria;
-    searchCriteria["Username"] = username;
-    searchCriteria["Password"] = password;
+    searchCriteria["Username"] = attempt.username;
+
+    // Fetch the account number, admin status and credential in one lookup
+    attempt.cacheGeneration = LoginCache::instance()->generation();
+    QSqlRecord account = databaseManager->fetchRow("Accounts",
+                                                   {"AccountNumber", "Admin", "Password"},
+                                                   searchCriteria);
+    if (!account.isEmpty())
+    {
+        attempt.accountFound = true;
+        attempt.principal.accountNumber = account.value("AccountNumber").toLongLong();
+        attempt.principal.isAdmin = account.value("Admin").toBool();
+        attempt.credential = account.value("Password").toString();
+    }
+    return attempt;
+}
 
-    // Fetch the account number and admin status
-    QVariant accountNumberData = databaseManager->fetchData("Accounts", "AccountNumber",
-                                           searchCriteria);
-    QVariant adminData = databaseManager->fetchData("Accounts", "Admin", searchCriteria);
+void AccountManager::verifyLogin(LoginAttempt *attempt)
+{
+    if (attempt->cached)
+    {
+        return;
+    }
 
-    if (!accountNumberData.isNull() && !adminData.isNull())
+    // Unknown users cost a full verification too, the reply time does not tell them apart
+    if (!attempt->accountFound)
     {
-        // Login successful
-        responseJson["loginSuccess"] = true;
-        responseJson["accountNumber"] = accountNumberData.toLongLong();
-        responseJson["isAdmin"] = adminData.toBool();
+        PasswordHasher::verifyPassword(attempt->password, PasswordHasher::dummyCredential());
+        return;
     }
-    else
+
+    bool needsRehash;
+    attempt->verified = PasswordHasher::verifyPassword(attempt->password, attempt->credential,
+                                                       &needsRehash);
+    if (attempt->verified && needsRehash)
+    {
+        attempt->upgradedCredential = PasswordHasher::hashPassword(attempt->password);
+    }
+}
+
+QJsonObject AccountManager::finishLogin(const LoginAttempt &attempt)
+{
+    QJsonObject responseJson;
+    responseJson["loginSuccess"] = false;
+
+    if (!attempt.verified)
     {
         // Login failed
-        logger.log("Login failed.");
+        LOG_INFO(logger, "Login failed.");
+        return responseJson;
     }
 
-    return responseJson;
+    // Plaintext and cheaper hashes are upgraded, unless the credential changed meanwhile
+    if (!attempt.upgradedCredential.isEmpty())
+    {
+        QJsonObject credentialData;
+        credentialData["Password"] = attempt.upgradedCredential;
+        QJsonObject upgradeCriteria;
+        upgradeCriteria["AccountNumber"] = attempt.principal.accountNumber;
+        upgradeCriteria["Password"] = attempt.credential;
+        if (!databaseManager->updateData("Accounts", credentialData, upgradeCriteria))
+        {
+            LOG_WARNING(logger, "Failed to upgrade the stored credential.");
+        }
+    }
+
+    if (!attempt.cached)
+    {
+        LoginCache::instance()->insert(attempt.username, attempt.password, attempt.principal,
+                                       attempt.cacheGeneration);
+    }
 
+    // Login successful
+    responseJson["loginSuccess"] = true;
+    responseJson["accountNumber"] = attempt.principal.accountNumber;
+    responseJson["isAdmin"] = attempt.principal.isAdmin;
+    return responseJson;
 }
 
 QJsonObject AccountManager::getAccountNumber(QJsonObject requestJson)
@@ -72,7 +146,7 @@ QJsonObject AccountManager::getAccountNumber(QJsonObject requestJson)
     else
     {
         // User not found
-        logger.log("User not found.");
+        LOG_INFO(logger, "User not found.");
     }
 
     return responseJson;
@@ -86,24 +160,36 @@ QJsonObject AccountManager::getAccountBalance(QJsonObject requestJson)
     // Extract the account number from the request JSON
     qint64 accountNumber = requestJson["accountNumber"].toVariant().toLongLong();
 
+    // Hot accounts are answered from memory
+    Money cachedBalance;
+    if (BalanceCache::instance()->lookup(accountNumber, &cachedBalance))
+    {
+        responseJson["balance"] = cachedBalance.toJson();
+        responseJson["accountFound"] = true;
+        return responseJson;
+    }
+
     // Prepare the search criteria
     QJsonObject searchCriteria;
     searchCriteria["AccountNumber"] = accountNumber;
 
     // Fetch the account balance
+    quint64 cacheGeneration = BalanceCache::instance()->generation(accountNumber);
     QVariant balance = databaseManager->fetchData("Users_Personal_Data", "Balance", searchCriteria);
 
     if (!balance.isNull())
     {
         // Account found
-        responseJson["balance"] = balance.toDouble();
+        Money accountBalance = Money::fromVariant(balance);
+        BalanceCache::instance()->fill(accountNumber, accountBalance, cacheGeneration);
+        responseJson["balance"] = accountBalance.toJson();
         responseJson["accountFound"] = true;
     }
     else
     {
         // Account not found
 
-        logger.log("Account not found.");
+        LOG_INFO(logger, "Account not found.");
     }
 
     return responseJson;
@@ -117,10 +203,23 @@ QJsonObject AccountManager::createNewAccount(QJsonObject requestJson)
     // Extract the necessary data from the request JSON
     bool isAdmin = requestJson["isAdmin"].toBool();
     QString username = requestJson["username"].toString();
-    QString password = requestJson["password"].toString();
+    // Hashed on the hashing pool by the connection, journaled records carry only the hash
+    QString credential = requestJson["passwordHash"].toString();
+    if (credential.isEmpty())
+    {
+        // Journal replay only: records written before hashes were journaled carry the password.
+        // A live request never hashes here, on the connection's thread.
+        if (!requestJson.contains("journalSequence"))
+        {
+            responseJson["errorMessage"] = "Password was not hashed.";
+            LOG_ERROR(logger, "createNewAccount reached without a password hash.");
+            return responseJson;
+        }
+        credential = PasswordHasher::hashPassword(requestJson["password"].toString());
+    }
     QString name = requestJson["name"].toString();
     int age = requestJson["age"].toInt();
-    double balance = 0.0;
+    Money balance;
 
     // Prepare the search criteria
     QJsonObject searchCriteria;
@@ -132,7 +231,7 @@ QJsonObject AccountManager::createNewAccount(QJsonObject requestJson)
     if (!usernameExists.isNull() && usernameExists.toInt() > 0)
     {
         responseJson["errorMessage"] = "Username already exists.";
-        logger.log("Username already exists.");
+        LOG_INFO(logger, "Username already exists.");
         return responseJson;
     }
 
@@ -140,21 +239,21 @@ QJsonObject AccountManager::createNewAccount(QJsonObject requestJson)
     if (!databaseManager->startDatabaseTransaction())
     {
         responseJson["errorMessage"] = "Failed to start a transaction for createNewAccount.";
-        logger.log("Failed to start a transaction for createNewAccount.");
+        LOG_ERROR(logger, "Failed to start a transaction for createNewAccount.");
         return responseJson;
     }
 
     // Insert the new account into the Accounts table
     QJsonObject accountData;
     accountData["Username"] = username;
-    accountData["Password"] = password;
+    accountData["Password"] = credential;
     accountData["Admin"] = isAdmin;
 
     qint64 accountNumber = databaseManager->insertData("Accounts", accountData);
     if (!accountNumber)
     {
         responseJson["errorMessage"] = "Failed to insert new account";
-        logger.log("Failed to insert new account.");
+        LOG_ERROR(logger, "Failed to insert new account.");
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
@@ -164,12 +263,12 @@ QJsonObject AccountManager::createNewAccount(QJsonObject requestJson)
     personalData["AccountNumber"] = accountNumber;
     personalData["Name"] = name;
     personalData["Age"] = age;
-    personalData["Balance"] = balance;
+    personalData["Balance"] = balance.toMinorUnits();
 
     if (!databaseManager->insertData("Users_Personal_Data", personalData))
     {
         responseJson["errorMessage"] = "Failed to insert personal data.";
-        logger.log("Failed to insert personal data.");
+        LOG_ERROR(logger, "Failed to insert personal data.");
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
@@ -178,7 +277,7 @@ QJsonObject AccountManager::createNewAccount(QJsonObject requestJson)
     if (!databaseManager->commitDatabaseTransaction())
     {
         responseJson["errorMessage"] = "Failed to commit transaction for createNewAccount.";
-        logger.log("Failed to commit transaction for createNewAccount.");
+        LOG_ERROR(logger, "Failed to commit transaction for createNewAccount.");
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
@@ -200,11 +299,14 @@ QJsonObject AccountManager::deleteAccount(QJsonObject requestJson)
     QJsonObject searchCriteria;
     searchCriteria["AccountNumber"] = accountNumber;
 
+    // Drops the cached balance however the deletion ends
+    BalanceWriteScope balanceWrite(accountNumber);
+
     // Start a transaction
     if (!databaseManager->startDatabaseTransaction())
     {
         responseJson["errorMessage"] = "Failed to start a transaction for deleteAccount.";
-        logger.log("Failed to start a transaction for deleteAccount.");
+        LOG_ERROR(logger, "Failed to start a transaction for deleteAccount.");
         return responseJson;
     }
 
@@ -212,7 +314,7 @@ QJsonObject AccountManager::deleteAccount(QJsonObject requestJson)
     if (!databaseManager->removeData("Accounts", searchCriteria))
     {
         responseJson["errorMessage"] = "Failed to delete account from Accounts table.";
-        logger.log("Failed to delete account from Accounts table.");
+        LOG_ERROR(logger, "Failed to delete account from Accounts table.");
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
@@ -221,7 +323,7 @@ QJsonObject AccountManager::deleteAccount(QJsonObject requestJson)
     if (!databaseManager->removeData("Users_Personal_Data", searchCriteria))
     {
         responseJson["errorMessage"] = "Failed to delete account from Users_Personal_Data table.";
-        logger.log("Failed to delete account from Users_Personal_Data table.");
+        LOG_ERROR(logger, "Failed to delete account from Users_Personal_Data table.");
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
@@ -230,7 +332,7 @@ QJsonObject AccountManager::deleteAccount(QJsonObject requestJson)
     if (!databaseManager->removeData("Transaction_History", searchCriteria))
     {
         responseJson["errorMessage"] = "Failed to delete transaction history for the account.";
-        logger.log("Failed to delete transaction history for the account.");
+        LOG_ERROR(logger, "Failed to delete transaction history for the account.");
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
@@ -238,15 +340,16 @@ QJsonObject AccountManager::deleteAccount(QJsonObject requestJson)
     // Commit the transaction
     if (!databaseManager->commitDatabaseTransaction())
     {
-        logger.log("Failed to commit transaction for deleteAccount.");
+        LOG_ERROR(logger, "Failed to commit transaction for deleteAccount.");
         if (!databaseManager->rollbackDatabaseTransaction())
         {
-            logger.log("Failed to rollback transaction for deleteAccount.");
+            LOG_ERROR(logger, "Failed to rollback transaction for deleteAccount.");
         }
         responseJson["errorMessage"] = "failed";
         return responseJson;
     }
 
+    LoginCache::instance()->removeAccount(accountNumber);
     responseJson["deleteAccountSuccess"] = true;
     return responseJson;
 }
@@ -260,6 +363,20 @@ QJsonObject AccountManager::updateUserData(QJsonObject requestJson)
     QString username = requestJson["username"].toString();
     QString name = requestJson["name"].toString();
     QString password = requestJson["password"].toString();
+    // Hashed on the hashing pool by the connection, journaled records carry only the hash
+    QString credential = requestJson["passwordHash"].toString();
+    if (credential.isEmpty() && !password.isEmpty())
+    {
+        // Journal replay only: records written before hashes were journaled carry the password.
+        // A live request never hashes here, on the connection's thread.
+        if (!requestJson.contains("journalSequence"))
+        {
+            responseJson["errorMessage"] = "Password was not hashed.";
+            LOG_ERROR(logger, "updateUserData reached without a password hash.");
+            return responseJson;
+        }
+        credential = PasswordHasher::hashPassword(password);
+    }
 
     // Prepare the search criteria
     QJsonObject searchCriteria;
@@ -269,7 +386,7 @@ QJsonObject AccountManager::updateUserData(QJsonObject requestJson)
     if (!databaseManager->startDatabaseTransaction())
     {
         responseJson["errorMessage"] = "Failed to start a transaction for updateUserData.";
-        logger.log("Failed to start a transaction for updateUserData.");
+        LOG_ERROR(logger, "Failed to start a transaction for updateUserData.");
         return responseJson;
     }
 
@@ -278,7 +395,7 @@ QJsonObject AccountManager::updateUserData(QJsonObject requestJson)
     if (!accountNumberVariant.isValid())
     {
         responseJson["errorMessage"] = "Account not found";
-        logger.log("Account not found.");
+        LOG_INFO(logger, "Account not found.");
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
@@ -289,15 +406,15 @@ QJsonObject AccountManager::updateUserData(QJsonObject requestJson)
     updateSearchCriteria["AccountNumber"] = accountNumber;
 
     // Update the password in the Accounts table
-    if (!password.isEmpty())
+    if (!credential.isEmpty())
     {
         QJsonObject passwordData;
-        passwordData["Password"] = password;
+        passwordData["Password"] = credential;
 
         if (!databaseManager->updateData("Accounts", passwordData, searchCriteria))
         {
             responseJson["errorMessage"] = "failed to update password";
-            logger.log("Failed to update password.");
+            LOG_ERROR(logger, "Failed to update password.");
             databaseManager->rollbackDatabaseTransaction();
             return responseJson;
         }
@@ -312,7 +429,7 @@ QJsonObject AccountManager::updateUserData(QJsonObject requestJson)
         if (!databaseManager->updateData("Users_Personal_Data", nameData, updateSearchCriteria))
         {
             responseJson["errorMessage"] = "failed to update name";
-            logger.log("Failed to update name.");
+            LOG_ERROR(logger, "Failed to update name.");
             databaseManager->rollbackDatabaseTransaction();
             return responseJson;
         }
@@ -321,15 +438,21 @@ QJsonObject AccountManager::updateUserData(QJsonObject requestJson)
     // Commit the transaction
     if (!databaseManager->commitDatabaseTransaction())
     {
-        logger.log("Failed to commit transaction for updateUserData.");
+        LOG_ERROR(logger, "Failed to commit transaction for updateUserData.");
         if (!databaseManager->rollbackDatabaseTransaction())
         {
-            logger.log("Failed to rollback transaction for updateUserData.");
+            LOG_ERROR(logger, "Failed to rollback transaction for updateUserData.");
         }
         responseJson["errorMessage"] = "Failed to commit transaction.";
         return responseJson;
     }
 
+    // Drops the old password, also a login that read it while this update was running
+    if (!credential.isEmpty())
+    {
+        LoginCache::instance()->remove(username);
+    }
+
     responseJson["updateSuccess"] = true;
     return responseJson;
 }
@@ -339,46 +462,51 @@ QJsonObject AccountManager::viewDatabase()
     QJsonObject responseJson;
     responseJson["fetchUserDataSuccess"] = false;
 
-    // Using the DatabaseManager pointer to get the QSqlDatabase object
-    QSqlDatabase dbConnection = databaseManager->getDatabase();
-    QSqlQuery fetchAllUserRecordsQuery(dbConnection);
-    fetchAllUserRecordsQuery.prepare
+    // Use the connection's cached prepared statement
+    QSqlQuery *fetchAllUserRecordsQuery = databaseManager->preparedQuery
         ("SELECT Accounts.AccountNumber, Accounts.Username, Accounts.Admin,"
          " Users_Personal_Data.Name, "
          "Users_Personal_Data.Balance,"
          " Users_Personal_Data.Age "
          "FROM Accounts JOIN Users_Personal_Data "
          "ON Accounts.AccountNumber = Users_Personal_Data.AccountNumber");
+    if (fetchAllUserRecordsQuery == nullptr)
+    {
+        responseJson["errorMessage"] = "failed";
+        return responseJson;
+    }
 
-    if (!fetchAllUserRecordsQuery.exec())
+    if (!fetchAllUserRecordsQuery->exec())
     {
         responseJson["errorMessage"] = "failed";
-        logger.log("Failed to fetch all user data.");
-        logger.log("Error: " + fetchAllUserRecordsQuery.lastError().text());
+        LOG_ERROR(logger, "Failed to fetch all user data.");
+        LOG_ERROR(logger, "Error: " + fetchAllUserRecordsQuery->lastError().text());
+        fetchAllUserRecordsQuery->finish();
         return responseJson;
     }
 
     // Create a JSON array to store user data
     QJsonArray userDataArray;
 
-    while (fetchAllUserRecordsQuery.next())
+    while (fetchAllUserRecordsQuery->next())
     {
         QJsonObject userDataJson;
-        userDataJson["AccountNumber"] = fetchAllUserRecordsQuery.
+        userDataJson["AccountNumber"] = fetchAllUserRecordsQuery->
                                         value("AccountNumber").toLongLong();
-        userDataJson["Username"] = fetchAllUserRecordsQuery.
+        userDataJson["Username"] = fetchAllUserRecordsQuery->
                                    value("Username").toString();
-        userDataJson["isAdmin"] = fetchAllUserRecordsQuery.
+        userDataJson["isAdmin"] = fetchAllUserRecordsQuery->
                                   value("Admin").toBool();
-        userDataJson["Name"] = fetchAllUserRecordsQuery.
+        userDataJson["Name"] = fetchAllUserRecordsQuery->
                                value("Name").toString();
-        userDataJson["Balance"] = fetchAllUserRecordsQuery.
-                                  value("Balance").toDouble();
-        userDataJson["Age"] = fetchAllUserRecordsQuery.
+        userDataJson["Balance"] = Money::fromVariant(fetchAllUserRecordsQuery->
+                                                     value("Balance")).toJson();
+        userDataJson["Age"] = fetchAllUserRecordsQuery->
                               value("Age").toInt();
 
         userDataArray.append(userDataJson);
     }
+    fetchAllUserRecordsQuery->finish();
 
     responseJson["fetchUserDataSuccess"] = true;
     responseJson["userData"] = userDataArray;
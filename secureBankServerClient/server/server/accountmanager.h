@@ -4,6 +4,10 @@
 #include <QObject>
 
 #include "DatabaseManager.h"
+#include "Money.h"
+#include "BalanceCache.h"
+#include "LoginCache.h"
+#include "PasswordHasher.h"
 #include "Logger.h"
 
 class AccountManager : public QObject
@@ -14,6 +18,29 @@ public:
     AccountManager(DatabaseManager* databaseManager, QObject *parent = nullptr);
     ~AccountManager();
 
+    // Connection used by the following calls, leased per request by the caller
+    void setDatabaseManager(DatabaseManager* databaseManager);
+
+    // Login split in steps so the password can be verified on the hashing pool:
+    // lookupLogin reads the stored credential, verifyLogin hashes, finishLogin replies
+    struct LoginAttempt
+    {
+        QString username;
+        QString password;
+        QString credential;
+        LoginCache::Principal principal;
+        quint64 cacheGeneration = 0;
+        bool accountFound = false;
+        // Answered from the LoginCache, no verification needed
+        bool cached = false;
+        bool verified = false;
+        // Replaces the stored credential once the login succeeded
+        QString upgradedCredential;
+    };
+    LoginAttempt lookupLogin(const QJsonObject &requestJson);
+    static void verifyLogin(LoginAttempt *attempt);
+    QJsonObject finishLogin(const LoginAttempt &attempt);
+
     // Functions related to account management
     QJsonObject login(QJsonObject requestJson);
     QJsonObject getAccountNumber(QJsonObject requestJson);
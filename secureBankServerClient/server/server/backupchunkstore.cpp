@@ -0,0 +1,356 @@
+#include "BackupChunkStore.h"
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define MANIFEST_VERSION "chunkstore 1"
+
+// Contents must be on disk before the file is renamed into place
+static bool syncFile(QFile &file)
+{
+    if (!file.flush())
+    {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return _commit(file.handle()) == 0;
+#else
+    return ::fsync(file.handle()) == 0;
+#endif
+}
+
+// Makes renames and removals in path durable
+static bool syncDirectory(const QString &path)
+{
+#ifdef Q_OS_WIN
+    // Directories cannot be opened for syncing, NTFS journals its metadata
+    Q_UNUSED(path);
+    return true;
+#else
+    int fd = ::open(QFile::encodeName(path).constData(), O_RDONLY | O_DIRECTORY);
+    if (fd < 0)
+    {
+        return false;
+    }
+    bool synced = ::fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#endif
+}
+
+BackupChunkStore::BackupChunkStore(const QString &storeDirectory, int chunkSize, QObject *parent)
+    : QObject(parent), storeDirectory(storeDirectory), chunkSize(chunkSize),
+      logger("BackupChunkStore")
+{
+    LOG_DEBUG(logger, "BackupChunkStore Object Created.");
+}
+
+BackupChunkStore::~BackupChunkStore()
+{
+    LOG_DEBUG(logger, "BackupChunkStore Object Destroyed.");
+}
+
+QString BackupChunkStore::manifestDirectory() const
+{
+    return storeDirectory + "/manifests";
+}
+
+QString BackupChunkStore::chunkPath(const QByteArray &hash) const
+{
+    // Two character fan out keeps directories small
+    return QString("%1/chunks/%2/%3").
+           arg(storeDirectory,
+               QString::fromLatin1(hash.left(2)),
+               QString::fromLatin1(hash));
+}
+
+bool BackupChunkStore::storeSnapshot(const QString &snapshotFileName, const QString &manifestName)
+{
+    QFile snapshotFile(snapshotFileName);
+    if (!snapshotFile.open(QIODevice::ReadOnly))
+    {
+        LOG_ERROR(logger, "Failed to open snapshot: " + snapshotFileName);
+        return false;
+    }
+
+    QDir dir;
+    dir.mkpath(manifestDirectory());
+
+    // Written under a temporary name so a crash never leaves a manifest with missing chunks
+    QString manifestFileName = QString("%1/%2.manifest").arg(manifestDirectory(), manifestName);
+    QFile manifestFile(manifestFileName + ".tmp");
+    if (!manifestFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        LOG_ERROR(logger, "Failed to create manifest: " + manifestFileName);
+        return false;
+    }
+
+    QTextStream manifest(&manifestFile);
+    manifest << MANIFEST_VERSION << '\n';
+    manifest << "chunkSize " << chunkSize << '\n';
+    manifest << "size " << snapshotFile.size() << '\n';
+
+    qint64 totalChunks = 0;
+    qint64 newChunks = 0;
+    qint64 bytesWritten = 0;
+    bool success = true;
+    // Directories that got new chunks, synced once before the manifest refers to them
+    QSet<QString> chunkDirectories;
+
+    while (!snapshotFile.atEnd())
+    {
+        QByteArray chunk = snapshotFile.read(chunkSize);
+        if (chunk.isEmpty())
+        {
+            LOG_ERROR(logger, "Failed to read snapshot: " + snapshotFile.errorString());
+            success = false;
+            break;
+        }
+
+        QByteArray hash = QCryptographicHash::hash(chunk, QCryptographicHash::Sha256).toHex();
+        ++totalChunks;
+        if (!QFile::exists(chunkPath(hash)))
+        {
+            if (!writeChunk(hash, chunk))
+            {
+                success = false;
+                break;
+            }
+            ++newChunks;
+            chunkDirectories.insert(QFileInfo(chunkPath(hash)).absolutePath());
+            bytesWritten += QFileInfo(chunkPath(hash)).size();
+        }
+        manifest << hash << '\n';
+    }
+
+    manifest.flush();
+    if (success && !syncFile(manifestFile))
+    {
+        LOG_ERROR(logger, "Failed to sync manifest: " + manifestFileName);
+        success = false;
+    }
+    manifestFile.close();
+
+    // New fan out directories are entries of the chunks directory
+    if (!chunkDirectories.isEmpty())
+    {
+        chunkDirectories.insert(storeDirectory + "/chunks");
+    }
+    for (const QString &chunkDirectory : chunkDirectories)
+    {
+        if (success && !syncDirectory(chunkDirectory))
+        {
+            LOG_ERROR(logger, "Failed to sync chunk directory: " + chunkDirectory);
+            success = false;
+        }
+    }
+
+    if (!success || !QFile::rename(manifestFile.fileName(), manifestFileName) ||
+        !syncDirectory(manifestDirectory()))
+    {
+        LOG_ERROR(logger, "Failed to store snapshot: " + snapshotFileName);
+        QFile::remove(manifestFile.fileName());
+        return false;
+    }
+
+    LOG_INFO(logger, QString("Stored %1: %2 chunks, %3 new, %4 bytes written.").
+              arg(manifestName).
+              arg(totalChunks).
+              arg(newChunks).
+              arg(bytesWritten));
+    return true;
+}
+
+bool BackupChunkStore::writeChunk(const QByteArray &hash, const QByteArray &chunk)
+{
+    QString path = chunkPath(hash);
+    QDir dir;
+    dir.mkpath(QFileInfo(path).absolutePath());
+
+    // Level 1 is several times faster than the default and database pages compress well anyway
+    QByteArray compressed = qCompress(chunk, 1);
+
+    QFile chunkFile(path + ".tmp");
+    if (!chunkFile.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+        chunkFile.write(compressed) != compressed.size() || !syncFile(chunkFile))
+    {
+        LOG_ERROR(logger, "Failed to write chunk: " + path);
+        chunkFile.remove();
+        return false;
+    }
+    chunkFile.close();
+
+    if (!QFile::rename(chunkFile.fileName(), path))
+    {
+        LOG_ERROR(logger, "Failed to move chunk into place: " + path);
+        chunkFile.remove();
+        return false;
+    }
+    return true;
+}
+
+bool BackupChunkStore::readManifest(const QString &manifestFileName, qint64 *snapshotSize,
+                                    QList<QByteArray> *hashes)
+{
+    QFile manifestFile(manifestFileName);
+    if (!manifestFile.open(QIODevice::ReadOnly))
+    {
+        LOG_ERROR(logger, "Failed to open manifest: " + manifestFileName);
+        return false;
+    }
+
+    if (manifestFile.readLine().trimmed() != MANIFEST_VERSION)
+    {
+        LOG_ERROR(logger, "Unsupported manifest: " + manifestFileName);
+        return false;
+    }
+
+    while (!manifestFile.atEnd())
+    {
+        QByteArray line = manifestFile.readLine().trimmed();
+        if (line.startsWith("chunkSize ") || line.isEmpty())
+        {
+            continue;
+        }
+        if (line.startsWith("size "))
+        {
+            *snapshotSize = line.mid(5).toLongLong();
+            continue;
+        }
+        hashes->append(line);
+    }
+    return true;
+}
+
+bool BackupChunkStore::restoreSnapshot(const QString &manifestFileName, const QString &targetFileName)
+{
+    qint64 snapshotSize = -1;
+    QList<QByteArray> hashes;
+    if (!readManifest(manifestFileName, &snapshotSize, &hashes))
+    {
+        return false;
+    }
+
+    // Reassembled under a temporary name so a failed restore never leaves a truncated target
+    QFile targetFile(targetFileName + ".tmp");
+    if (!targetFile.open(QIODevice::WriteOnly | QIODevice::Truncate))
+    {
+        LOG_ERROR(logger, "Failed to create restore target: " + targetFileName);
+        return false;
+    }
+
+    for (const QByteArray &hash : hashes)
+    {
+        QFile chunkFile(chunkPath(hash));
+        if (!chunkFile.open(QIODevice::ReadOnly))
+        {
+            LOG_ERROR(logger, "Missing chunk: " + QString::fromLatin1(hash));
+            targetFile.remove();
+            return false;
+        }
+
+        QByteArray chunk = qUncompress(chunkFile.readAll());
+        if (QCryptographicHash::hash(chunk, QCryptographicHash::Sha256).toHex() != hash)
+        {
+            LOG_ERROR(logger, "Corrupt chunk: " + QString::fromLatin1(hash));
+            targetFile.remove();
+            return false;
+        }
+        if (targetFile.write(chunk) != chunk.size())
+        {
+            LOG_ERROR(logger, "Failed to write restore target: " + targetFile.errorString());
+            targetFile.remove();
+            return false;
+        }
+    }
+
+    if (!syncFile(targetFile))
+    {
+        LOG_ERROR(logger, "Failed to sync restore target: " + targetFileName);
+        targetFile.remove();
+        return false;
+    }
+    targetFile.close();
+    if (targetFile.size() != snapshotSize)
+    {
+        LOG_ERROR(logger, "Restored snapshot has the wrong size: " + targetFileName);
+        targetFile.remove();
+        return false;
+    }
+
+    if ((QFile::exists(targetFileName) && !QFile::remove(targetFileName)) ||
+        !targetFile.rename(targetFileName))
+    {
+        LOG_ERROR(logger, "Failed to move restore target into place: " + targetFileName);
+        targetFile.remove();
+        return false;
+    }
+
+    LOG_INFO(logger, QString("Restored %1 into %2.").arg(manifestFileName, targetFileName));
+    return true;
+}
+
+QString BackupChunkStore::latestManifest() const
+{
+    // Manifest names carry their timestamp, the last one by name is the newest
+    QDir dir(manifestDirectory());
+    QStringList manifests = dir.entryList(QStringList() << "*.manifest", QDir::Files, QDir::Name);
+    if (manifests.isEmpty())
+    {
+        return QString();
+    }
+    return dir.filePath(manifests.last());
+}
+
+int BackupChunkStore::collectGarbage()
+{
+    // Manifests added or pruned must stay that way after a crash, or a sweep could
+    // delete chunks of a manifest that reappears
+    if (!syncDirectory(manifestDirectory()))
+    {
+        LOG_ERROR(logger, "Failed to sync manifest directory, chunks are not collected.");
+        return 0;
+    }
+
+    // Mark every chunk a remaining manifest refers to
+    QSet<QByteArray> referencedChunks;
+    QDir dir(manifestDirectory());
+    const QStringList manifests = dir.entryList(QStringList() << "*.manifest", QDir::Files);
+    for (const QString &manifest : manifests)
+    {
+        qint64 snapshotSize = -1;
+        QList<QByteArray> hashes;
+        if (!readManifest(dir.filePath(manifest), &snapshotSize, &hashes))
+        {
+            // Never sweep on an incomplete picture
+            return 0;
+        }
+        for (const QByteArray &hash : hashes)
+        {
+            referencedChunks.insert(hash);
+        }
+    }
+
+    // Sweep the rest, leftovers of interrupted writes included
+    int removedChunks = 0;
+    QDirIterator chunkIterator(storeDirectory + "/chunks", QDir::Files, QDirIterator::Subdirectories);
+    while (chunkIterator.hasNext())
+    {
+        QString chunkFileName = chunkIterator.next();
+        QByteArray hash = QFileInfo(chunkFileName).fileName().toLatin1();
+        if (!referencedChunks.contains(hash) && QFile::remove(chunkFileName))
+        {
+            ++removedChunks;
+        }
+    }
+
+    if (removedChunks > 0)
+    {
+        LOG_INFO(logger, QString("Removed %1 unreferenced chunks.").arg(removedChunks));
+    }
+    return removedChunks;
+}
@@ -0,0 +1,55 @@
+#ifndef BACKUPCHUNKSTORE_H
+#define BACKUPCHUNKSTORE_H
+
+#include <QObject>
+#include <QString>
+#include <QByteArray>
+#include <QSet>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDirIterator>
+#include <QTextStream>
+#include <QCryptographicHash>
+
+#include "Logger.h"
+
+// Content addressed backup store. A snapshot is split into fixed size chunks named by
+// their SHA-256, only chunks not already stored are compressed and written, and a
+// manifest lists the chunks in order. Unchanged pages cost nothing in later backups.
+//
+//   <store>/chunks/ab/abcdef...      qCompress'ed chunk
+//   <store>/manifests/<name>.manifest
+class BackupChunkStore : public QObject
+{
+    Q_OBJECT
+
+public:
+    BackupChunkStore(const QString &storeDirectory = "backup", int chunkSize = 64 * 1024,
+                     QObject *parent = nullptr);
+    ~BackupChunkStore();
+
+    // Adds snapshotFileName to the store under manifestName
+    bool storeSnapshot(const QString &snapshotFileName, const QString &manifestName);
+    // Reassembles the snapshot of manifestFileName into targetFileName, which is only
+    // replaced once the whole snapshot was restored
+    bool restoreSnapshot(const QString &manifestFileName, const QString &targetFileName);
+
+    QString manifestDirectory() const;
+    // Newest manifest by name, empty when the store has none
+    QString latestManifest() const;
+    // Deletes every chunk no manifest refers to, returns the number of chunks removed
+    int collectGarbage();
+
+private:
+    QString storeDirectory;
+    int chunkSize;
+    Logger logger;
+
+    QString chunkPath(const QByteArray &hash) const;
+    bool writeChunk(const QByteArray &hash, const QByteArray &chunk);
+    bool readManifest(const QString &manifestFileName, qint64 *snapshotSize,
+                      QList<QByteArray> *hashes);
+};
+
+#endif // BACKUPCHUNKSTORE_H
@@ -0,0 +1,176 @@
+#include "BackupEngine.h"
+
+#include <sqlite3.h>
+
+#define DESTINATION_CONNECTION "BackupEngineDestinationConnection"
+
+BackupEngine::Options BackupEngine::options;
+
+BackupEngine::BackupEngine(QObject *parent)
+    : QObject(parent), logger("BackupEngine")
+{
+    LOG_DEBUG(logger, "BackupEngine Object Created.");
+}
+
+BackupEngine::~BackupEngine()
+{
+    LOG_DEBUG(logger, "BackupEngine Object Destroyed.");
+}
+
+void BackupEngine::setOptions(const Options &options)
+{
+    BackupEngine::options = options;
+}
+
+bool BackupEngine::runBackup(const QString &destinationFileName)
+{
+    QElapsedTimer backupTimer;
+    backupTimer.start();
+
+    // Connections belong to the thread that opened them, so the source is opened here
+    if (sourceDatabase == nullptr)
+    {
+        sourceDatabase = new DatabaseManager("BackupEngineSourceConnection", this);
+    }
+    if (!sourceDatabase->openConnection())
+    {
+        LOG_ERROR(logger, "Failed to open the source database for backup.");
+        emit backupFinished(false, destinationFileName, backupTimer.elapsed());
+        return false;
+    }
+
+    // Written under a temporary name so an interrupted backup never looks complete
+    QString temporaryFileName = destinationFileName + ".part";
+    QFile::remove(temporaryFileName);
+
+    bool success = copyPages(temporaryFileName);
+    sourceDatabase->closeConnection();
+
+    if (success && !QFile::rename(temporaryFileName, destinationFileName))
+    {
+        LOG_ERROR(logger, "Failed to move the backup into place: " + destinationFileName);
+        success = false;
+    }
+    if (!success)
+    {
+        QFile::remove(temporaryFileName);
+    }
+
+    emit backupFinished(success, destinationFileName, backupTimer.elapsed());
+    return success;
+}
+
+bool BackupEngine::copyPages(const QString &destinationFileName)
+{
+    bool success = false;
+    {
+        QSqlDatabase destination = QSqlDatabase::addDatabase("QSQLITE", DESTINATION_CONNECTION);
+        destination.setDatabaseName(destinationFileName);
+        if (!destination.open())
+        {
+            LOG_ERROR(logger, "Failed to create backup file: " + destination.lastError().text());
+        }
+        else
+        {
+            sqlite3 *sourceHandle = nativeHandle(sourceDatabase->getDatabase());
+            sqlite3 *destinationHandle = nativeHandle(destination);
+            if (sourceHandle == nullptr || destinationHandle == nullptr)
+            {
+                LOG_ERROR(logger, "The SQL driver does not expose a SQLite handle.");
+            }
+            else
+            {
+                success = stepBackup(sourceHandle, destinationHandle);
+            }
+            destination.close();
+        }
+    }
+    QSqlDatabase::removeDatabase(DESTINATION_CONNECTION);
+    return success;
+}
+
+bool BackupEngine::stepBackup(sqlite3 *sourceHandle, sqlite3 *destinationHandle)
+{
+    sqlite3_backup *backup = sqlite3_backup_init(destinationHandle, "main", sourceHandle, "main");
+    if (backup == nullptr)
+    {
+        LOG_ERROR(logger, QString("Failed to start backup: %1").
+                   arg(QString::fromUtf8(sqlite3_errmsg(destinationHandle))));
+        return false;
+    }
+
+    int pagesPerStep = options.pagesPerStep;
+    int restarts = 0;
+    int previousRemaining = -1;
+    int reportedPercent = -1;
+    int busyRetries = 0;
+    int result;
+
+    do
+    {
+        result = sqlite3_backup_step(backup, pagesPerStep);
+
+        int totalPages = sqlite3_backup_pagecount(backup);
+        int remainingPages = sqlite3_backup_remaining(backup);
+
+        // A write through another connection makes SQLite start the copy over
+        if (previousRemaining >= 0 && remainingPages > previousRemaining)
+        {
+            ++restarts;
+            if (restarts >= options.maxRestarts && pagesPerStep > 0)
+            {
+                LOG_WARNING(logger, QString("Backup restarted %1 times, copying the rest in one step.").
+                             arg(restarts));
+                pagesPerStep = -1;
+            }
+        }
+        previousRemaining = remainingPages;
+
+        int percent = totalPages > 0 ? int(qint64(totalPages - remainingPages) * 100 / totalPages) : 100;
+        if (percent != reportedPercent)
+        {
+            reportedPercent = percent;
+            emit backupProgress(totalPages - remainingPages, totalPages);
+        }
+
+        if (result == SQLITE_BUSY || result == SQLITE_LOCKED)
+        {
+            // A lock held for this long is not going away, give up instead of spinning
+            if (++busyRetries > options.maxBusyRetries)
+            {
+                LOG_ERROR(logger, QString("Backup failed: the source stayed locked for %1 retries.").
+                           arg(options.maxBusyRetries));
+                sqlite3_backup_finish(backup);
+                return false;
+            }
+            QThread::msleep(options.busyRetryDelayMs);
+            continue;
+        }
+        busyRetries = 0;
+
+        if (result == SQLITE_OK && options.stepDelayMs > 0)
+        {
+            QThread::msleep(options.stepDelayMs);
+        }
+    } while (result == SQLITE_OK || result == SQLITE_BUSY || result == SQLITE_LOCKED);
+
+    // Reports the error of the failing step, if any
+    result = sqlite3_backup_finish(backup);
+    if (result != SQLITE_OK)
+    {
+        LOG_ERROR(logger, QString("Backup failed: %1").
+                   arg(QString::fromUtf8(sqlite3_errstr(result))));
+        return false;
+    }
+    return true;
+}
+
+sqlite3 *BackupEngine::nativeHandle(const QSqlDatabase &database)
+{
+    QVariant handle = database.driver()->handle();
+    if (handle.isValid() && qstrcmp(handle.typeName(), "sqlite3*") == 0)
+    {
+        return *static_cast<sqlite3 **>(handle.data());
+    }
+    return nullptr;
+}
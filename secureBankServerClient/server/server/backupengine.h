@@ -0,0 +1,65 @@
+#ifndef BACKUPENGINE_H
+#define BACKUPENGINE_H
+
+#include <QObject>
+#include <QThread>
+#include <QSqlDatabase>
+#include <QSqlDriver>
+#include <QVariant>
+#include <QFile>
+#include <QElapsedTimer>
+
+#include "DatabaseManager.h"
+#include "Logger.h"
+
+struct sqlite3;
+
+// Online backup through the SQLite backup API. Pages are copied a few at a time
+// on the backup thread, the source is only read locked while a step runs
+// so clients keep reading and writing during the backup.
+class BackupEngine : public QObject
+{
+    Q_OBJECT
+
+public:
+    struct Options
+    {
+        // Pages copied per sqlite3_backup_step
+        int pagesPerStep = 256;
+        // Pause between steps so request threads get the disk
+        int stepDelayMs = 5;
+        // Pause before retrying a step that found the source locked
+        int busyRetryDelayMs = 50;
+        // Consecutive steps that may find the source locked before the backup fails
+        int maxBusyRetries = 100;
+        // Writers restart the copy, after this many restarts the rest is copied in one step
+        int maxRestarts = 3;
+    };
+
+    BackupEngine(QObject *parent = nullptr);
+    ~BackupEngine();
+
+    // Shared by every engine, set once at startup
+    static void setOptions(const Options &options);
+
+public slots:
+    // Copies the live database into destinationFileName, blocks until done
+    bool runBackup(const QString &destinationFileName);
+
+signals:
+    // Emitted whenever the copied percentage changes
+    void backupProgress(int copiedPages, int totalPages);
+    void backupFinished(bool success, const QString &destinationFileName, qint64 elapsedMs);
+
+private:
+    DatabaseManager *sourceDatabase = nullptr;
+    Logger logger;
+
+    static Options options;
+
+    bool copyPages(const QString &destinationFileName);
+    bool stepBackup(sqlite3 *sourceHandle, sqlite3 *destinationHandle);
+    static sqlite3 *nativeHandle(const QSqlDatabase &database);
+};
+
+#endif // BACKUPENGINE_H
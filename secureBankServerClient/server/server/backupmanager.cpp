@@ -1,17 +1,32 @@
 #include "backupmanager.h"
 
-BackupManager::BackupManager(DatabaseManager* dbManager, QObject *parent)
-    : QObject(parent), dbManager(dbManager), logger("BackupManager")
+BackupManager::BackupManager(int pruneDelayMs, int chunkSize, QObject *parent)
+    : QObject(parent), pruneDelayMs(pruneDelayMs), logger("BackupManager")
 {
-    logger.log("BackupManager Object Created.");
+    // Children follow the manager onto the backup thread
+    backupEngine = new BackupEngine(this);
+    chunkStore = new BackupChunkStore("backup", chunkSize, this);
+    connect(backupEngine, &BackupEngine::backupProgress, this, &BackupManager::handleBackupProgress);
+    connect(backupEngine, &BackupEngine::backupFinished, this, &BackupManager::handleBackupFinished);
+
+    backupTimer = new QTimer(this);
+    connect(backupTimer, &QTimer::timeout, this, &BackupManager::createFullBackup);
+
+    LOG_DEBUG(logger, "BackupManager Object Created.");
 }
 
 BackupManager::~BackupManager()
 {
-    logger.log("BackupManager Object Destroyed.");
+    LOG_DEBUG(logger, "BackupManager Object Destroyed.");
 }
 
-void BackupManager::createFullBackup()
+void BackupManager::startSchedule()
+{
+    // Start the timer to trigger every 6 hours for periodic backups
+    backupTimer->start(6 * 60 * 60 * 1000);
+}
+
+QString BackupManager::nextBackupName()
 {
     QDir dir;
     if (!dir.exists("backup"))
@@ -19,33 +34,50 @@ void BackupManager::createFullBackup()
         dir.mkpath("backup");
     }
 
-    if (!dbManager->openConnection())
+    // Backups are named after their timestamp
+    QString timestamp = QDateTime::currentDateTime().toString("yyyyMMddHHmmss");
+    return QString("backup_%1").arg(timestamp);
+}
+
+void BackupManager::createFullBackup()
+{
+    // Runs on the backup thread, requests and new connections are never held up.
+    // The snapshot is only a staging file, the chunk store keeps the backup.
+    backupEngine->runBackup(QString("backup/%1.snapshot").arg(nextBackupName()));
+}
+
+void BackupManager::handleBackupProgress(int copiedPages, int totalPages)
+{
+    LOG_DEBUG(logger, QString("Backup progress: %1 of %2 pages.").
+               arg(copiedPages).
+               arg(totalPages));
+}
+
+void BackupManager::handleBackupFinished(bool success, const QString &backupFileName, qint64 elapsedMs)
+{
+    if (!success)
     {
-        logger.log("Failed to open database connection.");
+        LOG_ERROR(logger, "Backup Creation Failed: " + backupFileName);
         return;
     }
 
-    QSqlDatabase dbConnection = dbManager->getDatabase();
-    QSqlQuery backUpQuery(dbConnection);
-
-    // Generate a timestamp
-    QString timestamp = QDateTime::currentDateTime().toString("yyyyMMddHHmmss");
-
-    // Save the backup in the backup directory with a timestamp in its name
-    QString backupFileName = QString("backup/backup_%1.db").arg(timestamp);
-    QString vacuumCommand = QString("VACUUM INTO '%1';").arg(backupFileName);
-    if (!backUpQuery.exec(vacuumCommand))
+    QString backupName = QFileInfo(backupFileName).completeBaseName();
+    bool stored = chunkStore->storeSnapshot(backupFileName, backupName);
+    QFile::remove(backupFileName);
+    if (!stored)
     {
-        logger.log("Backup Creation Failed: " + backUpQuery.lastError().text());
-        dbManager->closeConnection();
+        LOG_ERROR(logger, "Backup Creation Failed: " + backupName);
         return;
     }
 
-    logger.log("Created a full backup of the database.");
+    LOG_INFO(logger, QString("Created a full backup of the database in %1 ms: %2").
+              arg(elapsedMs).
+              arg(backupName));
 
-    deleteOldBackups();
+    // Records older than this backup are only needed to replay from older backups
+    TransactionJournal::instance()->rotate();
 
-    dbManager->closeConnection();
+    deleteOldBackups();
 }
 
 void BackupManager::deleteOldBackups()
@@ -60,6 +92,25 @@ void BackupManager::deleteOldBackups()
     QDateTime oneMonthAgo = QDateTime::currentDateTime().addMonths(-1);
 
     deleteFilesOlderThan(files, oneMonthAgo);
+
+    // Chunks only go away once no remaining manifest shares them
+    QDir manifestDir(chunkStore->manifestDirectory());
+    if (manifestDir.exists())
+    {
+        deleteFilesOlderThan(manifestDir.entryInfoList(QStringList() << "*.manifest", QDir::Files,
+                                                       QDir::Time),
+                             oneMonthAgo);
+        chunkStore->collectGarbage();
+    }
+
+    // Journal segments are kept as long as the backups they extend
+    QDir journalDir(TransactionJournal::instance()->directory());
+    if (journalDir.exists())
+    {
+        deleteFilesOlderThan(journalDir.entryInfoList(QStringList() << "journal_*.log", QDir::Files,
+                                                      QDir::Time),
+                             oneMonthAgo);
+    }
 }
 
 void BackupManager::deleteFilesOlderThan(const QFileInfoList& files,
@@ -70,6 +121,8 @@ void BackupManager::deleteFilesOlderThan(const QFileInfoList& files,
         if (file.birthTime() < time)
         {
             QFile::remove(file.absoluteFilePath());
+            // Spread large deletions out so they don't compete with the database for the disk
+            QThread::msleep(pruneDelayMs);
         }
     }
 }
@@ -149,23 +202,24 @@ void BackupManager::handleEmailSent()
     {
         if (reply->error() == QNetworkReply::NoError)
         {
-            logger.log("Email sent successfully");
+            LOG_INFO(logger, "Email sent successfully");
         }
         else
         {
-            logger.log("Failed to send email: " + reply->errorString());
+            LOG_ERROR(logger, "Failed to send email: " + reply->errorString());
         }
         reply->deleteLater();
         reply = nullptr;
     }
     else
     {
-        logger.log("Reply object is null");
+        LOG_WARNING(logger, "Reply object is null");
     }
 }
 
 void BackupManager::handleShutdown()
 {
-    logger.log("Received shutdown signal. Creating a full backup before shutting down.");
+    LOG_INFO(logger, "Received shutdown signal. Creating a full backup before shutting down.");
+    backupTimer->stop();
     createFullBackup();
 }
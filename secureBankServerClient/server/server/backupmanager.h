@@ -10,9 +10,12 @@
 #include <QNetworkReply>
 #include <QUrlQuery>
 #include <QUrl>
+#include <QThread>
+#include <QTimer>
 
-
-#include "DatabaseManager.h"
+#include "BackupEngine.h"
+#include "BackupChunkStore.h"
+#include "TransactionJournal.h"
 #include "Logger.h"
 
 class BackupManager : public QObject
@@ -20,18 +23,27 @@ class BackupManager : public QObject
     Q_OBJECT
 
 public:
-    BackupManager(DatabaseManager* dbManager, QObject *parent = nullptr);
+    // Lives on a dedicated low priority thread, pruneDelayMs paces file deletions
+    BackupManager(int pruneDelayMs = 20, int chunkSize = 64 * 1024, QObject *parent = nullptr);
     ~BackupManager();
 
+public slots:
+    // Starts the periodic backups, called once the backup thread runs
+    void startSchedule();
     void createFullBackup();
     void deleteOldBackups();
     void handleShutdown();
 
 private slots:
     void handleEmailSent();
+    void handleBackupProgress(int copiedPages, int totalPages);
+    void handleBackupFinished(bool success, const QString &backupFileName, qint64 elapsedMs);
 
 private:
-    DatabaseManager* dbManager;
+    BackupEngine *backupEngine;
+    BackupChunkStore *chunkStore;
+    QTimer *backupTimer;
+    int pruneDelayMs;
     QNetworkReply *reply = nullptr;
     Logger logger;
 
@@ -39,6 +51,7 @@ private:
     void deleteFilesOlderThan(const QFileInfoList& files,
                               const QDateTime& time);
     void emailNotificationAfterBackup();
+    QString nextBackupName();
 };
 
 #endif // BACKUPMANAGER_H
@@ -0,0 +1,135 @@
+#include "BalanceCache.h"
+
+BalanceCache *BalanceCache::instance()
+{
+    static BalanceCache *cache = new BalanceCache();
+    return cache;
+}
+
+BalanceCache::BalanceCache()
+    : capacityPerShard(4096)
+{}
+
+void BalanceCache::setCapacityPerShard(int capacity)
+{
+    capacityPerShard.storeRelaxed(qMax(0, capacity));
+}
+
+BalanceCache::Shard &BalanceCache::shardFor(qint64 accountNumber)
+{
+    // Account numbers are handed out in sequence, consecutive accounts land in different shards
+    return shards[static_cast<quint64>(accountNumber) % BALANCE_CACHE_SHARDS];
+}
+
+bool BalanceCache::lookup(qint64 accountNumber, Money *balance)
+{
+    Shard &shard = shardFor(accountNumber);
+    QReadLocker locker(&shard.lock);
+    QHash<qint64, Money>::const_iterator it = shard.balances.constFind(accountNumber);
+    if (it == shard.balances.constEnd())
+    {
+        return false;
+    }
+    *balance = it.value();
+    return true;
+}
+
+quint64 BalanceCache::generation(qint64 accountNumber)
+{
+    Shard &shard = shardFor(accountNumber);
+    QReadLocker locker(&shard.lock);
+    return shard.generation;
+}
+
+void BalanceCache::fill(qint64 accountNumber, const Money &balance, quint64 generation)
+{
+    Shard &shard = shardFor(accountNumber);
+    QWriteLocker locker(&shard.lock);
+
+    // A write began or ended since the balance was read, it may already be stale
+    if (shard.generation != generation || shard.writers.contains(accountNumber))
+    {
+        return;
+    }
+    store(shard, accountNumber, balance);
+}
+
+void BalanceCache::beginWrite(qint64 accountNumber)
+{
+    Shard &shard = shardFor(accountNumber);
+    QWriteLocker locker(&shard.lock);
+
+    Writers &writers = shard.writers[accountNumber];
+    if (writers.count > 0)
+    {
+        writers.overlapped = true;
+    }
+    writers.count++;
+    shard.generation++;
+}
+
+void BalanceCache::endWrite(qint64 accountNumber, const Money *committedBalance)
+{
+    Shard &shard = shardFor(accountNumber);
+    QWriteLocker locker(&shard.lock);
+
+    shard.generation++;
+    QHash<qint64, Writers>::iterator it = shard.writers.find(accountNumber);
+    if (it == shard.writers.end())
+    {
+        return;
+    }
+
+    // Only the last of overlapping writers knows nothing is still in flight,
+    // but not whether its own commit was the last one
+    bool overlapped = it->overlapped;
+    if (--it->count > 0)
+    {
+        it->overlapped = true;
+        shard.balances.remove(accountNumber);
+        return;
+    }
+    shard.writers.erase(it);
+
+    if (committedBalance != nullptr && !overlapped)
+    {
+        store(shard, accountNumber, *committedBalance);
+    }
+    else
+    {
+        shard.balances.remove(accountNumber);
+    }
+}
+
+void BalanceCache::store(Shard &shard, qint64 accountNumber, const Money &balance)
+{
+    int capacity = capacityPerShard.loadRelaxed();
+    if (capacity == 0)
+    {
+        return;
+    }
+
+    // Dropping an entry is always safe, make room by evicting an arbitrary one
+    if (shard.balances.size() >= capacity && !shard.balances.contains(accountNumber))
+    {
+        shard.balances.erase(shard.balances.begin());
+    }
+    shard.balances.insert(accountNumber, balance);
+}
+
+BalanceWriteScope::BalanceWriteScope(qint64 accountNumber)
+    : accountNumber(accountNumber)
+{
+    BalanceCache::instance()->beginWrite(accountNumber);
+}
+
+BalanceWriteScope::~BalanceWriteScope()
+{
+    BalanceCache::instance()->endWrite(accountNumber, isCommitted ? &committedBalance : nullptr);
+}
+
+void BalanceWriteScope::committed(const Money &balance)
+{
+    committedBalance = balance;
+    isCommitted = true;
+}
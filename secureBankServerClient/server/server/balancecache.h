@@ -0,0 +1,79 @@
+#ifndef BALANCECACHE_H
+#define BALANCECACHE_H
+
+#include <QHash>
+#include <QReadWriteLock>
+#include <QAtomicInt>
+
+#include "Money.h"
+
+#define BALANCE_CACHE_SHARDS 64
+
+// Process wide cache of committed balances keyed by account number, split into shards
+// with their own lock so requests for different accounts never wait on each other.
+// Entries are filled lazily by reads and replaced by writers after they commit.
+// SQLite stays the source of truth: whenever the cached value could be behind, the
+// entry is dropped and the next read goes to the database again.
+class BalanceCache
+{
+public:
+    static BalanceCache *instance();
+
+    // Accounts kept per shard, 0 disables the cache
+    void setCapacityPerShard(int capacity);
+
+    bool lookup(qint64 accountNumber, Money *balance);
+
+    // Taken before reading a balance from the database, a fill is only accepted
+    // when no write touched the shard in between
+    quint64 generation(qint64 accountNumber);
+    void fill(qint64 accountNumber, const Money &balance, quint64 generation);
+
+    // Called around every database write of an account's balance, see BalanceWriteScope
+    void beginWrite(qint64 accountNumber);
+    // committedBalance is nullptr when the write failed or its result is unknown
+    void endWrite(qint64 accountNumber, const Money *committedBalance);
+
+private:
+    BalanceCache();
+
+    struct Writers
+    {
+        int count = 0;
+        // Writes overlapped, their results may be stored in the wrong order
+        bool overlapped = false;
+    };
+
+    struct Shard
+    {
+        QReadWriteLock lock;
+        QHash<qint64, Money> balances;
+        QHash<qint64, Writers> writers;
+        quint64 generation = 0;
+    };
+
+    Shard &shardFor(qint64 accountNumber);
+    void store(Shard &shard, qint64 accountNumber, const Money &balance);
+
+    Shard shards[BALANCE_CACHE_SHARDS];
+    QAtomicInt capacityPerShard;
+};
+
+// Registers a balance write for the lifetime of the scope. Unless committed() was
+// called the cached balance is dropped when the scope ends, on every early return.
+class BalanceWriteScope
+{
+public:
+    explicit BalanceWriteScope(qint64 accountNumber);
+    ~BalanceWriteScope();
+
+    // The balance the account was committed with
+    void committed(const Money &balance);
+
+private:
+    qint64 accountNumber;
+    Money committedBalance;
+    bool isCommitted = false;
+};
+
+#endif // BALANCECACHE_H
@@ -1,41 +1,97 @@
 #include "ClientRunnable.h"
 
+#include <openssl/ssl.h>
+
+ClientRunnable::Options ClientRunnable::options;
+QSslConfiguration ClientRunnable::sslConfiguration;
+QAtomicInteger<qint64> ClientRunnable::handshakeCount;
+QAtomicInteger<qint64> ClientRunnable::resumedHandshakeCount;
+QAtomicInteger<qint64> ClientRunnable::totalHandshakeTimeUs;
+QAtomicInteger<qint64> ClientRunnable::resumedHandshakeTimeUs;
+
+bool ClientRunnable::loadSslConfiguration(const QString &certificateFileName, const QString &keyFileName)
+{
+    Logger logger("ClientRunnable");
+
+    QList<QSslCertificate> certificateChain = QSslCertificate::fromPath(certificateFileName, QSsl::Pem);
+    if (certificateChain.isEmpty())
+    {
+        LOG_ERROR(logger, "Failed to load the server certificate: " + certificateFileName);
+        return false;
+    }
+
+    QFile keyFile(keyFileName);
+    if (!keyFile.open(QIODevice::ReadOnly))
+    {
+        LOG_ERROR(logger, "Failed to open the private key: " + keyFileName);
+        return false;
+    }
+    QSslKey privateKey(&keyFile, QSsl::Rsa, QSsl::Pem);
+    keyFile.close();
+    if (privateKey.isNull())
+    {
+        LOG_ERROR(logger, "Failed to load the private key: " + keyFileName);
+        return false;
+    }
+
+    QSslConfiguration configuration = QSslConfiguration::defaultConfiguration();
+    configuration.setLocalCertificateChain(certificateChain);
+    configuration.setPrivateKey(privateKey);
+    // Set the protocol to TLS 1.2
+    configuration.setProtocol(QSsl::TlsV1_2OrLater);
+    // Sessions are not resumed across connections: every server socket builds its own TLS
+    // context with its own ticket key, so a ticket issued on one connection cannot be
+    // decrypted on the next. The handshake metrics are expected to count every handshake as full.
+
+    // Implicitly shared, the sockets only copy a reference
+    sslConfiguration = configuration;
+    return true;
+}
+
+QString ClientRunnable::handshakeMetricsSummary()
+{
+    qint64 handshakes = handshakeCount.loadRelaxed();
+    qint64 resumed = resumedHandshakeCount.loadRelaxed();
+    qint64 full = handshakes - resumed;
+    qint64 resumedTimeUs = resumedHandshakeTimeUs.loadRelaxed();
+    qint64 fullTimeUs = totalHandshakeTimeUs.loadRelaxed() - resumedTimeUs;
+
+    return QString("TLS handshakes: %1, resumed: %2 (%3%), average full: %4 ms, "
+                   "average resumed: %5 ms").
+           arg(handshakes).
+           arg(resumed).
+           arg(handshakes > 0 ? resumed * 100.0 / handshakes : 0.0, 0, 'f', 1).
+           arg(full > 0 ? fullTimeUs / 1000.0 / full : 0.0, 0, 'f', 2).
+           arg(resumed > 0 ? resumedTimeUs / 1000.0 / resumed : 0.0, 0, 'f', 2);
+}
+
+void ClientRunnable::setOptions(const Options &options)
+{
+    ClientRunnable::options = options;
+}
+
 ClientRunnable::ClientRunnable(qintptr socketDescriptor, QObject *parent)
     : QObject(parent), socketDescriptor(socketDescriptor), logger("ClientRunnable")
 {
     if (socketDescriptor == -1)
     {
-        logger.log("Invalid socket descriptor.");
+        LOG_WARNING(logger, "Invalid socket descriptor.");
         return;
     }
 
+    // Fires at the nearest idle deadline instead of being restarted on every message
     idleTimer = new QTimer(this);
-    connect(idleTimer, &QTimer::timeout, this, &ClientRunnable::disconnectIdleClient);
-    idleTimer->start(IDLE_TIMEOUT);
+    idleTimer->setSingleShot(true);
+    connect(idleTimer, &QTimer::timeout, this, &ClientRunnable::checkIdleConnection);
+    lastMessageTimer.start();
+    lastRequestTimer.start();
+    scheduleIdleCheck();
 
-    logger.log("Object Created.");
+    LOG_DEBUG(logger, "Object Created.");
 }
 
 ClientRunnable::~ClientRunnable()
 {
-    if(databaseManager != nullptr)
-    {
-        databaseManager->closeConnection();
-        delete databaseManager;
-        QSqlDatabase::removeDatabase(QString::number(socketDescriptor));
-        databaseManager = nullptr;
-    }
-
-    // Check if the database connection was removed successfully
-    if(QSqlDatabase::contains(QString::number(socketDescriptor)))
-    {
-        logger.log("Failed to remove database connection.");
-    }
-    else
-    {
-        logger.log("Database connection removed successfully.");
-    }
-    
     // Delete the QTimer object
     if(idleTimer != nullptr)
     {
@@ -46,91 +102,396 @@ ClientRunnable::~ClientRunnable()
         delete idleTimer;
         idleTimer = nullptr;
     }
-    logger.log("Object Destroyed.");
+    LOG_DEBUG(logger, "Object Destroyed.");
 }
 
 void ClientRunnable::run()
 {
-    // Create QSslSocket
-    clientSocket = new QSslSocket();
+    // Create QSslSocket owned by this client so it is closed when the client is deleted
+    clientSocket = new QSslSocket(this);
 
-    // Load your local certificate and private key
-    clientSocket->setLocalCertificate("server.crt");
-    clientSocket->setPrivateKey("server.key");
-    // Set the protocol to TLS 1.2
-    clientSocket->setProtocol(QSsl::TlsV1_2OrLater);
+    // Certificate, key and protocol were loaded once at startup
+    clientSocket->setSslConfiguration(sslConfiguration);
 
     if (!clientSocket->setSocketDescriptor(socketDescriptor)) {
-        logger.log("Failed to set socket descriptor. Thread will be finished.");
+        LOG_ERROR(logger, "Failed to set socket descriptor. Client will be removed.");
         emit clientDisconnected(socketDescriptor);
+        deleteLater();
         return;
     }
 
-    // Create databaseManager object for the client connected
-    databaseManager = new DatabaseManager(QString::number(socketDescriptor), this);
-    if(databaseManager == nullptr)
-    {
-        logger.log("Failed to create DatabaseManager.");
-        return;
-    }
-    databaseManager->openConnection();
+    // Split the decrypted stream into length prefixed messages
+    messageFramer = new MessageFramer(clientSocket, this);
+
+    // One handler serves every request of this client until it goes idle
+    requestHandler = new RequestHandler(this);
 
     // Start the SSL handshake.
+    handshakeTimer.start();
     clientSocket->startServerEncryption();
 
     connect(clientSocket, &QSslSocket::encrypted,this,&ClientRunnable::handleEncrypted);
     connect(clientSocket, QOverload<const QList<QSslError>&>::of(&QSslSocket::sslErrors),
             this, &ClientRunnable::handleSslErrors);
-    connect(clientSocket, &QSslSocket::readyRead, this, &ClientRunnable::readyRead);
+    connect(messageFramer, &MessageFramer::messageReceived, this, &ClientRunnable::handleMessage);
+    connect(messageFramer, &MessageFramer::framingError, this, &ClientRunnable::handleFramingError);
     connect(clientSocket, &QSslSocket::disconnected, this, &ClientRunnable::socketDisconnected);
-    logger.log(QString("Client setup completed in thread ID: %1").
+    LOG_DEBUG(logger, QString("Client setup completed in thread ID: %1").
                arg((quintptr)QThread::currentThreadId()));
 }
 
 void ClientRunnable::handleEncrypted()
 {
-    logger.log("SSL handshake completed successfully.");
-    logger.log(QString("Client connected with IP: %1, socket descriptor: %2").
+    handshakeDurationUs = handshakeTimer.nsecsElapsed() / 1000;
+    bool resumed = isSessionResumed();
+    LOG_DEBUG(logger, QString("SSL handshake completed successfully in %1 us, session resumed: %2.").
+               arg(handshakeDurationUs).
+               arg(resumed));
+    recordHandshake(resumed);
+    LOG_INFO(logger, QString("Client connected with IP: %1, socket descriptor: %2").
                arg(clientSocket->peerAddress().toString()).
                arg(socketDescriptor));
 }
 
-void ClientRunnable::readyRead()
+void ClientRunnable::handleMessage(const QByteArray &message)
+{
+    // Any message shows the client is still there
+    lastMessageTimer.restart();
+
+    bool decoded;
+    QJsonObject requestJson = messageCodec.decodeRequest(message, &decoded);
+    if (!decoded)
+    {
+        LOG_WARNING(logger, "Failed to decode request, message dropped.");
+        return;
+    }
+
+    // Answered right away, a heartbeat neither leaves the idle state nor counts as a request
+    if (requestJson["requestId"].toInt() == HEARTBEAT_REQUEST)
+    {
+        QJsonObject responseJson;
+        responseJson["responseId"] = HEARTBEAT_REQUEST;
+        responseJson["correlationId"] = requestJson["correlationId"];
+        sendResponseToClient(messageCodec.encodeResponse(responseJson));
+        return;
+    }
+
+    lastRequestTimer.restart();
+    if (idle)
+    {
+        idle = false;
+        LOG_DEBUG(logger, "Client active again.");
+    }
+    // Only the server hashes passwords
+    requestJson.remove("passwordHash");
+
+    // Every record logged until the reply is sent carries this request's context
+    LogContextScope logContext(socketDescriptor, requestJson["requestId"].toInt(),
+                               requestJson["correlationId"].toInteger(-1));
+
+    int requestId = requestJson["requestId"].toInt();
+    if (requestId == NEGOTIATE_PROTOCOL_REQUEST)
+    {
+        // The reply still goes out with the old settings, the new ones apply afterwards
+        MessageCodec negotiatedCodec = messageCodec;
+        QJsonObject responseJson = negotiateProtocol(requestJson, &negotiatedCodec);
+        sendResponseToClient(messageCodec.encodeResponse(responseJson));
+        messageCodec = negotiatedCodec;
+        return;
+    }
+
+    // Passwords are hashed on the hashing pool, these requests are answered when it is done
+    QElapsedTimer requestTimer;
+    requestTimer.start();
+    if (requestId == LOGIN_REQUEST)
+    {
+        startLogin(requestJson, requestTimer);
+        return;
+    }
+    // A new account always gets a credential, an empty password included.
+    // An update without a password keeps the old one and needs no hash.
+    if (requestId == CREATE_ACCOUNT_REQUEST ||
+        (requestId == UPDATE_USER_DATA_REQUEST && !requestJson["password"].toString().isEmpty()))
+    {
+        startPasswordHashing(requestJson, requestTimer);
+        return;
+    }
+
+    processRequest(requestJson);
+    logRequestLatency(requestId, logContext.elapsedUs());
+}
+
+bool ClientRunnable::isSessionResumed() const
+{
+    // Only the OpenSSL backend exposes its SSL handle, other backends count every handshake as full
+    if (QSslSocket::activeBackend() != QLatin1String("openssl"))
+    {
+        return false;
+    }
+    SSL *ssl = static_cast<SSL *>(clientSocket->sslHandle());
+    return ssl != nullptr && SSL_session_reused(ssl) == 1;
+}
+
+void ClientRunnable::recordHandshake(bool resumed)
+{
+    handshakeCount.fetchAndAddRelaxed(1);
+    totalHandshakeTimeUs.fetchAndAddRelaxed(handshakeDurationUs);
+    if (resumed)
+    {
+        resumedHandshakeCount.fetchAndAddRelaxed(1);
+        resumedHandshakeTimeUs.fetchAndAddRelaxed(handshakeDurationUs);
+    }
+}
+
+void ClientRunnable::processRequest(const QJsonObject &requestJson)
+{
+    // Lease a connection from this worker's pool only for the duration of the request
+    DatabaseLease databaseLease(DatabaseConnectionPool::forCurrentThread());
+    QJsonObject responseJson;
+    if (databaseLease.database() == nullptr)
+    {
+        responseJson = serverBusyResponse(requestJson);
+    }
+    else
+    {
+        responseJson = activeRequestHandler()->handleRequest(requestJson, databaseLease.database());
+    }
+    sendResponseToClient(messageCodec.encodeResponse(responseJson));
+}
+
+void ClientRunnable::startLogin(const QJsonObject &requestJson, const QElapsedTimer &requestTimer)
 {
-    // Reset idle timer on every message received
-    idleTimer->start(IDLE_TIMEOUT);
+    AccountManager::LoginAttempt attempt;
+    {
+        DatabaseLease databaseLease(DatabaseConnectionPool::forCurrentThread());
+        if (databaseLease.database() == nullptr)
+        {
+            sendResponseToClient(messageCodec.encodeResponse(serverBusyResponse(requestJson)));
+            return;
+        }
+        attempt = activeRequestHandler()->lookupLogin(requestJson, databaseLease.database());
 
-    QByteArray data = clientSocket->readAll();
-    RequestHandler requestHandler(databaseManager, this);
-    QByteArray responseData = requestHandler.handleRequest(data);
-    sendResponseToClient(responseData);
+        // Recently verified, nothing to hash
+        if (attempt.cached)
+        {
+            QJsonObject responseJson = activeRequestHandler()->finishLogin(requestJson, attempt,
+                                                                           databaseLease.database());
+            sendResponseToClient(messageCodec.encodeResponse(responseJson));
+            logRequestLatency(LOGIN_REQUEST, requestTimer.nsecsElapsed() / 1000);
+            return;
+        }
+    }
+
+    bool scheduled = runOnHashingPool<AccountManager::LoginAttempt>([attempt]() mutable
+    {
+        AccountManager::verifyLogin(&attempt);
+        return attempt;
+    },
+    [this, requestJson, requestTimer](const AccountManager::LoginAttempt &verifiedAttempt)
+    {
+        LogContextScope logContext(socketDescriptor, requestJson["requestId"].toInt(),
+                                   requestJson["correlationId"].toInteger(-1));
+        QJsonObject responseJson;
+        DatabaseLease databaseLease(DatabaseConnectionPool::forCurrentThread());
+        if (databaseLease.database() == nullptr)
+        {
+            responseJson = serverBusyResponse(requestJson);
+        }
+        else
+        {
+            responseJson = activeRequestHandler()->finishLogin(requestJson, verifiedAttempt,
+                                                               databaseLease.database());
+        }
+        sendResponseToClient(messageCodec.encodeResponse(responseJson));
+        logRequestLatency(LOGIN_REQUEST, requestTimer.nsecsElapsed() / 1000);
+    });
+    if (!scheduled)
+    {
+        sendResponseToClient(messageCodec.encodeResponse(serverBusyResponse(requestJson)));
+    }
+}
+
+void ClientRunnable::startPasswordHashing(const QJsonObject &requestJson, const QElapsedTimer &requestTimer)
+{
+    bool scheduled = runOnHashingPool<QJsonObject>([requestJson]()
+    {
+        QJsonObject hashedRequestJson = requestJson;
+        hashedRequestJson["passwordHash"] = PasswordHasher::hashPassword(requestJson["password"].toString());
+        return hashedRequestJson;
+    },
+    [this, requestTimer](const QJsonObject &hashedRequestJson)
+    {
+        LogContextScope logContext(socketDescriptor, hashedRequestJson["requestId"].toInt(),
+                                   hashedRequestJson["correlationId"].toInteger(-1));
+        processRequest(hashedRequestJson);
+        logRequestLatency(hashedRequestJson["requestId"].toInt(), requestTimer.nsecsElapsed() / 1000);
+    });
+    if (!scheduled)
+    {
+        sendResponseToClient(messageCodec.encodeResponse(serverBusyResponse(requestJson)));
+    }
+}
+
+QJsonObject ClientRunnable::serverBusyResponse(const QJsonObject &requestJson)
+{
+    QJsonObject responseJson;
+    responseJson["errorMessage"] = "Server busy, please try again.";
+    responseJson["responseId"] = requestJson["requestId"];
+    responseJson["correlationId"] = requestJson["correlationId"];
+    return responseJson;
+}
+
+void ClientRunnable::logRequestLatency(int requestId, qint64 latencyUs)
+{
+    if (latencyUs >= SLOW_REQUEST_THRESHOLD_US)
+    {
+        LOG_WARNING(logger, QString("Slow request %1 took %2 us.").
+                     arg(requestId).
+                     arg(latencyUs));
+    }
+    else
+    {
+        LOG_DEBUG(logger, QString("Handled request %1 in %2 us.").
+                   arg(requestId).
+                   arg(latencyUs));
+    }
+}
+
+QJsonObject ClientRunnable::negotiateProtocol(const QJsonObject &requestJson,
+                                              MessageCodec *negotiatedCodec)
+{
+    QJsonObject responseJson;
+    responseJson["negotiateSuccess"] = false;
+
+    MessageCodec::Encoding encoding = negotiatedCodec->encoding();
+    if (requestJson.contains("encoding") &&
+        !MessageCodec::encodingFromName(requestJson["encoding"].toString(), &encoding))
+    {
+        responseJson["errorMessage"] = "Unsupported encoding.";
+        LOG_WARNING(logger, "Unsupported encoding requested: " + requestJson["encoding"].toString());
+    }
+    else
+    {
+        negotiatedCodec->setEncoding(encoding);
+        // Compression stays on unless the client turns it off
+        negotiatedCodec->setCompressionEnabled(requestJson["compression"].toBool(true));
+        responseJson["negotiateSuccess"] = true;
+        LOG_DEBUG(logger, QString("Client with socket descriptor %1 switched to %2 encoding, compression %3.").
+                   arg(socketDescriptor).
+                   arg(MessageCodec::encodingName(encoding)).
+                   arg(negotiatedCodec->compressionEnabled() ? "on" : "off"));
+    }
+
+    // The client keeps the connection open with heartbeats at this interval
+    responseJson["heartbeatIntervalMs"] = options.heartbeatIntervalMs;
+    responseJson["encoding"] = MessageCodec::encodingName(negotiatedCodec->encoding());
+    responseJson["compression"] = negotiatedCodec->compressionEnabled();
+    responseJson["responseId"] = NEGOTIATE_PROTOCOL_REQUEST;
+    responseJson["correlationId"] = requestJson["correlationId"];
+    return responseJson;
 }
 
 void ClientRunnable::sendResponseToClient(QByteArray responseData)
 {
-    if (clientSocket->write(responseData) == -1)
+    if (!messageFramer->sendMessage(responseData))
     {
-        logger.log("Failed to write data to client: " + clientSocket->errorString());
+        LOG_WARNING(logger, "Failed to write data to client: " + clientSocket->errorString());
     }
 }
 
 void ClientRunnable::handleSslErrors(const QList<QSslError> &errors)
 {
     for (const QSslError &error : errors) {
-        logger.log("SSL error: " + error.errorString());
+        LOG_WARNING(logger, "SSL error: " + error.errorString());
     }
 }
 
-void ClientRunnable::disconnectIdleClient()
+void ClientRunnable::handleFramingError(const QString &errorMessage)
 {
-    logger.log("Client idle. Disconnecting...");
+    LOG_WARNING(logger, "Framing error: " + errorMessage + " Disconnecting...");
     clientSocket->disconnectFromHost();
 }
 
+void ClientRunnable::checkIdleConnection()
+{
+    if (clientSocket == nullptr)
+    {
+        return;
+    }
+
+    if (options.maxSilenceMs > 0 && lastMessageTimer.elapsed() >= options.maxSilenceMs)
+    {
+        LOG_INFO(logger, "Client silent. Disconnecting...");
+        clientSocket->disconnectFromHost();
+        return;
+    }
+    if (options.maxIdleMs > 0 && lastRequestTimer.elapsed() >= options.maxIdleMs)
+    {
+        LOG_INFO(logger, "Client idle. Disconnecting...");
+        clientSocket->disconnectFromHost();
+        return;
+    }
+    if (!idle && lastRequestTimer.elapsed() >= options.idleStateMs)
+    {
+        enterIdleState();
+    }
+    scheduleIdleCheck();
+}
+
+void ClientRunnable::scheduleIdleCheck()
+{
+    // Nearest deadline still ahead, messages since the last check only push it further out
+    qint64 nextCheckMs = -1;
+    auto considerDeadline = [&nextCheckMs](qint64 remainingMs)
+    {
+        if (nextCheckMs < 0 || remainingMs < nextCheckMs)
+        {
+            nextCheckMs = remainingMs;
+        }
+    };
+    if (options.maxSilenceMs > 0)
+    {
+        considerDeadline(options.maxSilenceMs - lastMessageTimer.elapsed());
+    }
+    if (options.maxIdleMs > 0)
+    {
+        considerDeadline(options.maxIdleMs - lastRequestTimer.elapsed());
+    }
+    if (!idle)
+    {
+        considerDeadline(options.idleStateMs - lastRequestTimer.elapsed());
+    }
+
+    if (nextCheckMs >= 0)
+    {
+        // Rechecked at least daily, QTimer intervals are int milliseconds
+        idleTimer->start(static_cast<int>(qBound<qint64>(100, nextCheckMs, 24 * 3600 * 1000)));
+    }
+}
+
+void ClientRunnable::enterIdleState()
+{
+    // Keep the socket, TLS session and negotiated encoding, drop what only requests need
+    idle = true;
+    delete requestHandler;
+    requestHandler = nullptr;
+    messageFramer->releaseBuffer();
+    LOG_DEBUG(logger, "Client idle, request handler released.");
+}
+
+RequestHandler *ClientRunnable::activeRequestHandler()
+{
+    if (requestHandler == nullptr)
+    {
+        requestHandler = new RequestHandler(this);
+    }
+    return requestHandler;
+}
+
 void ClientRunnable::socketDisconnected()
 {
     emit clientDisconnected(socketDescriptor);
-    logger.log(QString("Client disconnected in thread ID: %1").
+    LOG_DEBUG(logger, QString("Client disconnected in thread ID: %1").
                arg((quintptr)QThread::currentThreadId()));
     deleteLater();
 }
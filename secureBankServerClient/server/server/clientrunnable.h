@@ -4,26 +4,66 @@
 #include <QObject>
 #include <QThread>
 #include <QSslSocket>
+#include <QSslConfiguration>
+#include <QSslCertificate>
+#include <QSslKey>
+#include <QFile>
+#include <QAtomicInteger>
 #include <QTimer>
+#include <QElapsedTimer>
+#include <QFuture>
+#include <QPromise>
+#include <functional>
+#include <memory>
 
 #include "RequestHandler.h"
-#include "DatabaseManager.h"
+#include "DatabaseConnectionPool.h"
+#include "MessageFramer.h"
+#include "MessageCodec.h"
+#include "PasswordHasher.h"
 #include "logger.h"
 
-// Idle time out 30 seconds
-#define IDLE_TIMEOUT 30000
+// Requests slower than this are logged as warnings
+#define SLOW_REQUEST_THRESHOLD_US 250000
+
+// Requests whose password is hashed or verified on the hashing pool
+#define LOGIN_REQUEST 0
+#define CREATE_ACCOUNT_REQUEST 3
+#define UPDATE_USER_DATA_REQUEST 9
 
 class ClientRunnable : public QObject
 {
     Q_OBJECT
 
 public:
+    struct Options
+    {
+        // Without a request for this long the connection frees its request handler and buffers,
+        // the socket stays open
+        int idleStateMs = 30000;
+        // Without any message, heartbeats included, the client is considered gone, 0 = never
+        int maxSilenceMs = 90000;
+        // Without a request for this long the client is disconnected even if it sends heartbeats,
+        // 0 = never
+        int maxIdleMs = 0;
+        // Heartbeat interval the clients are asked to use
+        int heartbeatIntervalMs = 25000;
+    };
+
     ClientRunnable(qintptr socketDescriptor, QObject *parent = nullptr);
     ~ClientRunnable();
 
+    // Shared by every connection, set once at startup
+    static void setOptions(const Options &options);
+
+    // Reads the certificate and key once at startup, every connection shares the configuration
+    static bool loadSslConfiguration(const QString &certificateFileName, const QString &keyFileName);
+    // Handshake count, time and the share of clients that resumed a TLS session
+    static QString handshakeMetricsSummary();
+
 public slots:
     void run();
-    void readyRead();
+    void handleMessage(const QByteArray &message);
     void sendResponseToClient(QByteArray responseData);
 
 signals:
@@ -31,16 +71,67 @@ signals:
 
 private slots:
     void handleEncrypted();
-    void disconnectIdleClient();
+    void checkIdleConnection();
     void socketDisconnected();
     void handleSslErrors(const QList<QSslError> &errors);
+    void handleFramingError(const QString &errorMessage);
 
 private:
     qintptr socketDescriptor;
     QSslSocket *clientSocket = nullptr;
-    DatabaseManager* databaseManager = nullptr;
+    MessageFramer *messageFramer = nullptr;
+    MessageCodec messageCodec;
+    RequestHandler *requestHandler = nullptr;
     QTimer *idleTimer = nullptr;
+    // Restarted on every message and every request, the idle timer only reads them when it fires
+    QElapsedTimer lastMessageTimer;
+    QElapsedTimer lastRequestTimer;
+    bool idle = false;
+    QElapsedTimer handshakeTimer;
+    qint64 handshakeDurationUs = 0;
     Logger logger;
+
+    static Options options;
+    static QSslConfiguration sslConfiguration;
+    static QAtomicInteger<qint64> handshakeCount;
+    static QAtomicInteger<qint64> resumedHandshakeCount;
+    static QAtomicInteger<qint64> totalHandshakeTimeUs;
+    static QAtomicInteger<qint64> resumedHandshakeTimeUs;
+
+    QJsonObject negotiateProtocol(const QJsonObject &requestJson,
+                                  MessageCodec *negotiatedCodec);
+    // Asks the TLS library itself, a client cannot tell from its side
+    bool isSessionResumed() const;
+    void recordHandshake(bool resumed);
+    void scheduleIdleCheck();
+    void enterIdleState();
+    // Creates the request handler again after the idle state dropped it
+    RequestHandler *activeRequestHandler();
+    void processRequest(const QJsonObject &requestJson);
+    void startLogin(const QJsonObject &requestJson, const QElapsedTimer &requestTimer);
+    void startPasswordHashing(const QJsonObject &requestJson, const QElapsedTimer &requestTimer);
+    static QJsonObject serverBusyResponse(const QJsonObject &requestJson);
+    void logRequestLatency(int requestId, qint64 latencyUs);
+
+    // Runs work on the hashing pool and then done on this client's thread.
+    // done is dropped if the client is gone by then. False when the pool is full.
+    template <typename T>
+    bool runOnHashingPool(const std::function<T()> &work, const std::function<void(const T &)> &done)
+    {
+        std::shared_ptr<QPromise<T>> promise = std::make_shared<QPromise<T>>();
+        QFuture<T> future = promise->future();
+        promise->start();
+        if (!PasswordHasher::schedule([promise, work]()
+            {
+                promise->addResult(work());
+                promise->finish();
+            }))
+        {
+            return false;
+        }
+        future.then(this, done);
+        return true;
+    }
 };
 
 #endif // CLIENTRUNNABLE_H
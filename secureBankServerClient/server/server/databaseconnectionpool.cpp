@@ -0,0 +1,171 @@
+#include "DatabaseConnectionPool.h"
+
+QThreadStorage<DatabaseConnectionPool*> DatabaseConnectionPool::threadPools;
+int DatabaseConnectionPool::maxConnectionsPerThread = 2;
+
+QAtomicInteger<qint64> DatabaseConnectionPool::openConnectionCount(0);
+QAtomicInteger<qint64> DatabaseConnectionPool::leaseCount(0);
+QAtomicInteger<qint64> DatabaseConnectionPool::openCount(0);
+QAtomicInteger<qint64> DatabaseConnectionPool::openTimeUs(0);
+QAtomicInteger<qint64> DatabaseConnectionPool::exhaustedCount(0);
+QAtomicInteger<qint64> DatabaseConnectionPool::totalLeaseTimeUs(0);
+QAtomicInteger<qint64> DatabaseConnectionPool::maxLeaseTimeUs(0);
+
+DatabaseConnectionPool::DatabaseConnectionPool()
+    : QObject(nullptr), logger("DatabaseConnectionPool")
+{
+    QThread *thread = QThread::currentThread();
+    poolName = thread->objectName();
+    if (poolName.isEmpty())
+    {
+        poolName = QString("Thread-%1").arg(reinterpret_cast<quintptr>(thread));
+    }
+    LOG_DEBUG(logger, QString("Pool created for %1.").arg(poolName));
+}
+
+DatabaseConnectionPool::~DatabaseConnectionPool()
+{
+    for (DatabaseManager *databaseManager : allConnections)
+    {
+        QString connectionName = databaseManager->getConnectionName();
+        databaseManager->closeConnection();
+        delete databaseManager;
+        QSqlDatabase::removeDatabase(connectionName);
+        openConnectionCount--;
+    }
+    LOG_DEBUG(logger, QString("Pool for %1 closed %2 connections.").
+               arg(poolName).arg(allConnections.size()));
+    allConnections.clear();
+    idleConnections.clear();
+}
+
+DatabaseConnectionPool *DatabaseConnectionPool::forCurrentThread()
+{
+    if (!threadPools.hasLocalData())
+    {
+        threadPools.setLocalData(new DatabaseConnectionPool());
+    }
+    return threadPools.localData();
+}
+
+void DatabaseConnectionPool::setMaxConnectionsPerThread(int maxConnections)
+{
+    maxConnectionsPerThread = qMax(1, maxConnections);
+}
+
+QString DatabaseConnectionPool::metricsSummary()
+{
+    qint64 leases = leaseCount.loadRelaxed();
+    qint64 averageLeaseUs = leases > 0 ? totalLeaseTimeUs.loadRelaxed() / leases : 0;
+    return QString("Connection pool: %1 open, %2 leases, %3 opens (%4 us), %5 exhausted, "
+                   "lease time avg %6 us max %7 us").
+        arg(openConnectionCount.loadRelaxed()).
+        arg(leases).
+        arg(openCount.loadRelaxed()).
+        arg(openTimeUs.loadRelaxed()).
+        arg(exhaustedCount.loadRelaxed()).
+        arg(averageLeaseUs).
+        arg(maxLeaseTimeUs.loadRelaxed());
+}
+
+DatabaseManager *DatabaseConnectionPool::acquire()
+{
+    if (!idleConnections.isEmpty())
+    {
+        leaseCount++;
+        return idleConnections.takeLast();
+    }
+
+    if (allConnections.size() >= maxConnectionsPerThread)
+    {
+        exhaustedCount++;
+        LOG_WARNING(logger, QString("Pool for %1 is exhausted.").arg(poolName));
+        return nullptr;
+    }
+
+    // No warm connection left, a new one is opened lazily on the request's time
+    QElapsedTimer openTimer;
+    openTimer.start();
+    DatabaseManager *databaseManager = openPooledConnection();
+    openCount++;
+    openTimeUs += openTimer.nsecsElapsed() / 1000;
+
+    if (databaseManager != nullptr)
+    {
+        leaseCount++;
+    }
+    return databaseManager;
+}
+
+void DatabaseConnectionPool::release(DatabaseManager *databaseManager, qint64 leaseTimeUs)
+{
+    if (databaseManager == nullptr)
+    {
+        return;
+    }
+
+    totalLeaseTimeUs += leaseTimeUs;
+    qint64 currentMax = maxLeaseTimeUs.loadRelaxed();
+    while (leaseTimeUs > currentMax &&
+           !maxLeaseTimeUs.testAndSetRelaxed(currentMax, leaseTimeUs, currentMax))
+    {
+    }
+
+    idleConnections.append(databaseManager);
+}
+
+void DatabaseConnectionPool::warmUp()
+{
+    if (!allConnections.isEmpty())
+    {
+        return;
+    }
+    DatabaseManager *databaseManager = openPooledConnection();
+    if (databaseManager != nullptr)
+    {
+        idleConnections.append(databaseManager);
+    }
+}
+
+DatabaseManager *DatabaseConnectionPool::openPooledConnection()
+{
+    QString connectionName = QString("%1-Connection-%2").
+                             arg(poolName).arg(allConnections.size());
+
+    DatabaseManager *databaseManager = new DatabaseManager(connectionName, this);
+    if (!databaseManager->openConnection())
+    {
+        delete databaseManager;
+        QSqlDatabase::removeDatabase(connectionName);
+        return nullptr;
+    }
+
+    // Load the schema and the first pages so the first request does not pay for it
+    QSqlQuery warmUpQuery(databaseManager->getDatabase());
+    if (!warmUpQuery.exec("SELECT COUNT(*) FROM sqlite_master;"))
+    {
+        LOG_WARNING(logger, "Failed to warm up connection: " + warmUpQuery.lastError().text());
+    }
+    warmUpQuery.finish();
+
+    allConnections.append(databaseManager);
+    openConnectionCount++;
+    LOG_DEBUG(logger, QString("Opened pooled connection '%1'.").arg(connectionName));
+    return databaseManager;
+}
+
+DatabaseLease::DatabaseLease(DatabaseConnectionPool *pool)
+    : pool(pool), databaseManager(pool->acquire())
+{
+    leaseTimer.start();
+}
+
+DatabaseLease::~DatabaseLease()
+{
+    pool->release(databaseManager, leaseTimer.nsecsElapsed() / 1000);
+}
+
+DatabaseManager *DatabaseLease::database() const
+{
+    return databaseManager;
+}
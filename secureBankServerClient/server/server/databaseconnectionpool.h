@@ -0,0 +1,76 @@
+#ifndef DATABASECONNECTIONPOOL_H
+#define DATABASECONNECTIONPOOL_H
+
+#include <QObject>
+#include <QList>
+#include <QThread>
+#include <QThreadStorage>
+#include <QElapsedTimer>
+#include <QAtomicInteger>
+
+#include "DatabaseManager.h"
+#include "Logger.h"
+
+// Bounded pool of open database connections owned by one worker thread.
+// SQLite connections can only be used by the thread that opened them, so every
+// worker gets its own pool and requests lease a connection only while they run.
+class DatabaseConnectionPool : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Pool of the calling thread, created on first use and closed when the thread ends
+    static DatabaseConnectionPool *forCurrentThread();
+    // Set once at startup before the workers are started
+    static void setMaxConnectionsPerThread(int maxConnections);
+    // Metrics aggregated over the pools of every thread
+    static QString metricsSummary();
+
+    ~DatabaseConnectionPool();
+
+    // Returns nullptr when every connection of this thread is leased out
+    DatabaseManager *acquire();
+    void release(DatabaseManager *databaseManager, qint64 leaseTimeUs);
+    // Open and warm one connection ahead of the first request
+    void warmUp();
+
+private:
+    DatabaseConnectionPool();
+
+    DatabaseManager *openPooledConnection();
+
+    QList<DatabaseManager*> idleConnections;
+    QList<DatabaseManager*> allConnections;
+    QString poolName;
+    Logger logger;
+
+    static QThreadStorage<DatabaseConnectionPool*> threadPools;
+    static int maxConnectionsPerThread;
+
+    static QAtomicInteger<qint64> openConnectionCount;
+    static QAtomicInteger<qint64> leaseCount;
+    // Connections opened lazily by acquire() and the time spent opening them.
+    // Nothing ever queues, an exhausted pool refuses the lease at once.
+    static QAtomicInteger<qint64> openCount;
+    static QAtomicInteger<qint64> openTimeUs;
+    static QAtomicInteger<qint64> exhaustedCount;
+    static QAtomicInteger<qint64> totalLeaseTimeUs;
+    static QAtomicInteger<qint64> maxLeaseTimeUs;
+};
+
+// Leases a connection from a pool for the lifetime of the object
+class DatabaseLease
+{
+public:
+    explicit DatabaseLease(DatabaseConnectionPool *pool);
+    ~DatabaseLease();
+
+    DatabaseManager *database() const;
+
+private:
+    DatabaseConnectionPool *pool;
+    DatabaseManager *databaseManager;
+    QElapsedTimer leaseTimer;
+};
+
+#endif // DATABASECONNECTIONPOOL_H
@@ -1,21 +1,27 @@
 #include "DatabaseManager.h"
 
+// Schema created by createTables, older databases are brought up to it by migrateSchema
+#define SCHEMA_VERSION 2
+
+PragmaProfile DatabaseManager::pragmaProfile = DatabaseManager::defaultPragmaProfile();
+
 DatabaseManager::DatabaseManager(const QString &connectionName, QObject *parent)
     : QObject(parent), connectionName(connectionName), logger("DatabaseManager")
 {
-    logger.log("DatabaseManager Object Created.");
+    LOG_DEBUG(logger, "DatabaseManager Object Created.");
     QSqlDatabase dbConnection = QSqlDatabase::addDatabase("QSQLITE", connectionName);
     dbConnection.setDatabaseName("bankdatabase.db");
 }
 
 DatabaseManager::~DatabaseManager()
 {
+    clearPreparedQueries();
     QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
     if (dbConnection.isOpen())
     {
         dbConnection.close();
     }
-    logger.log("DatabaseManager Object Destroyed.");
+    LOG_DEBUG(logger, "DatabaseManager Object Destroyed.");
 }
 
 bool DatabaseManager::openConnection()
@@ -23,35 +29,100 @@ bool DatabaseManager::openConnection()
     QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
     if (!dbConnection.open())
     {
-        logger.log(QString("Failed to Open database connection '%1'").arg(connectionName));
+        LOG_ERROR(logger, QString("Failed to Open database connection '%1'").arg(connectionName));
         return false;
     }
 
-    logger.log(QString("Opened database connection '%1'").arg(connectionName));
+    if (!applyPragmaProfile())
+    {
+        LOG_WARNING(logger, QString("Some pragmas failed on database connection '%1'").arg(connectionName));
+    }
+
+    LOG_DEBUG(logger, QString("Opened database connection '%1'").arg(connectionName));
     return true;
 }
 
+PragmaProfile DatabaseManager::defaultPragmaProfile()
+{
+    PragmaProfile profile;
+    // Readers no longer block behind writers and writers only lock the log
+    profile.append(qMakePair(QString("journal_mode"), QString("WAL")));
+    // Safe with WAL, commits no longer wait for a sync of the whole database
+    profile.append(qMakePair(QString("synchronous"), QString("NORMAL")));
+    // Negative values are KiB, 16 MB of page cache per connection
+    profile.append(qMakePair(QString("cache_size"), QString("-16000")));
+    profile.append(qMakePair(QString("mmap_size"), QString("268435456")));
+    // Wait for a competing writer instead of failing with SQLITE_BUSY
+    profile.append(qMakePair(QString("busy_timeout"), QString("5000")));
+    profile.append(qMakePair(QString("temp_store"), QString("MEMORY")));
+    return profile;
+}
+
+void DatabaseManager::setPragmaProfile(const PragmaProfile &profile)
+{
+    pragmaProfile = profile;
+}
+
+bool DatabaseManager::applyPragmaProfile()
+{
+    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
+    QSqlQuery pragmaQuery(dbConnection);
+
+    bool success = true;
+    for (const QPair<QString, QString> &pragma : pragmaProfile)
+    {
+        if (pragma.second.isEmpty())
+        {
+            continue;
+        }
+        if (!pragmaQuery.exec(QString("PRAGMA %1 = %2;").arg(pragma.first, pragma.second)))
+        {
+            LOG_ERROR(logger, QString("Failed to set PRAGMA %1: %2").
+                       arg(pragma.first, pragmaQuery.lastError().text()));
+            success = false;
+        }
+        pragmaQuery.finish();
+    }
+    return success;
+}
+
 QSqlDatabase DatabaseManager::getDatabase()
 {
     QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
     if (!dbConnection.isOpen())
     {
-        logger.log("Database connection is not open.");
+        LOG_WARNING(logger, "Database connection is not open.");
     }
     return dbConnection;
 }
 
+QString DatabaseManager::getConnectionName() const
+{
+    return connectionName;
+}
+
+void DatabaseManager::setDatabaseFileName(const QString &fileName)
+{
+    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName, false);
+    dbConnection.setDatabaseName(fileName);
+}
+
 void DatabaseManager::closeConnection()
 {
+    // Prepared statements belong to the connection and die with it
+    clearPreparedQueries();
+
     QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
     if (dbConnection.isOpen())
     {
         dbConnection.close();
-        logger.log(QString("Closed database connection '%1'").arg(connectionName));
+        LOG_DEBUG(logger, QString("Closed database connection '%1'").arg(connectionName));
+        LOG_DEBUG(logger, QString("Prepared statement cache: %1 hits, %2 misses").
+                   arg(cacheHits).arg(cacheMisses));
     }
     else
     {
-        logger.log(QString("Database connection '%1' is not open.").arg(connectionName));
+        LOG_WARNING(logger, QString("Database connection '%1' is not open.").arg(connectionName));
     }
 }
 
@@ -60,7 +131,12 @@ void DatabaseManager::initializeDatabase()
     QFile databaseFile("bankdatabase.db");
     if (databaseFile.exists())
     {
-        logger.log("bankdatabase already exists.");
+        LOG_DEBUG(logger, "bankdatabase already exists.");
+        // Databases created by older versions of the server
+        openConnection();
+        ensureJournalState();
+        migrateSchema();
+        closeConnection();
     }
     else
     {
@@ -68,14 +144,14 @@ void DatabaseManager::initializeDatabase()
         if (databaseFile.open(QIODevice::WriteOnly))
         {
             databaseFile.close();
-            logger.log("Created database file: bankdatabase.db");
+            LOG_INFO(logger, "Created database file: bankdatabase.db");
             openConnection();
             createTables();
             closeConnection();
         }
         else
         {
-            logger.log("Failed to create database file!");
+            LOG_ERROR(logger, "Failed to create database file!");
         }
     }
 }
@@ -88,7 +164,7 @@ bool DatabaseManager::createTables()
     // Begin transaction
     if (!dbConnection.transaction())
     {
-        logger.log("Failed to start a transaction for table creation.");
+        LOG_ERROR(logger, "Failed to start a transaction for table creation.");
         return false;
     }
 
@@ -99,8 +175,8 @@ bool DatabaseManager::createTables()
         " Admin BOOLEAN);";
     if (!createTablesQuery.exec(prep_accounts))
     {
-        logger.log("Failed execution for Accounts table.");
-        logger.log("Error: " + createTablesQuery.lastError().text());
+        LOG_ERROR(logger, "Failed execution for Accounts table.");
+        LOG_ERROR(logger, "Error: " + createTablesQuery.lastError().text());
         dbConnection.rollback();
         return false;
     }
@@ -108,7 +184,7 @@ bool DatabaseManager::createTables()
     // Insert default admin account
     QJsonObject defaultAdminData;
     defaultAdminData["Username"] = "admin";
-    defaultAdminData["Password"] = "admin";
+    defaultAdminData["Password"] = PasswordHasher::hashPassword("admin");
     defaultAdminData["Admin"] = true;
     if (!insertData("Accounts", defaultAdminData))
     {
@@ -119,12 +195,12 @@ bool DatabaseManager::createTables()
     // Create Users_Personal_Data table
     const QString prep_users_personal_data =
         "CREATE TABLE Users_Personal_Data (AccountNumber INTEGER PRIMARY KEY, Name TEXT,"
-        " Age INTEGER CHECK(Age >= 18 AND Age <= 120), Balance REAL, FOREIGN KEY(AccountNumber)"
-        " REFERENCES Accounts(AccountNumber));";
+        " Age INTEGER CHECK(Age >= 18 AND Age <= 120), Balance INTEGER NOT NULL DEFAULT 0,"
+        " FOREIGN KEY(AccountNumber) REFERENCES Accounts(AccountNumber));";
     if (!createTablesQuery.exec(prep_users_personal_data))
     {
-        logger.log("Failed execution for Personal Data table.");
-        logger.log("Error: " + createTablesQuery.lastError().text());
+        LOG_ERROR(logger, "Failed execution for Personal Data table.");
+        LOG_ERROR(logger, "Error: " + createTablesQuery.lastError().text());
         dbConnection.rollback();
         return false;
     }
@@ -132,12 +208,32 @@ bool DatabaseManager::createTables()
     // Create Transaction_History table
     const QString prep_transaction_history =
         "CREATE TABLE Transaction_History (TransactionID INTEGER PRIMARY KEY AUTOINCREMENT,"
-        " AccountNumber INTEGER, Date TEXT, Time TEXT, Amount REAL, FOREIGN KEY(AccountNumber)"
-        " REFERENCES Accounts(AccountNumber));";
+        " AccountNumber INTEGER, Date TEXT, Time TEXT, Amount INTEGER NOT NULL,"
+        " Timestamp INTEGER NOT NULL DEFAULT 0,"
+        " FOREIGN KEY(AccountNumber) REFERENCES Accounts(AccountNumber));";
     if (!createTablesQuery.exec(prep_transaction_history))
     {
-        logger.log("Failed execution for Transaction history table.");
-        logger.log("Error: " + createTablesQuery.lastError().text());
+        LOG_ERROR(logger, "Failed execution for Transaction history table.");
+        LOG_ERROR(logger, "Error: " + createTablesQuery.lastError().text());
+        dbConnection.rollback();
+        return false;
+    }
+
+    // History lookups are a range scan over one account, already in time order
+    const QString prep_transaction_history_index =
+        "CREATE INDEX Transaction_History_Account_Timestamp"
+        " ON Transaction_History (AccountNumber, Timestamp);";
+    if (!createTablesQuery.exec(prep_transaction_history_index))
+    {
+        LOG_ERROR(logger, "Failed execution for Transaction history index.");
+        LOG_ERROR(logger, "Error: " + createTablesQuery.lastError().text());
+        dbConnection.rollback();
+        return false;
+    }
+
+    if (!ensureJournalState() ||
+        !createTablesQuery.exec(QString("PRAGMA user_version = %1;").arg(SCHEMA_VERSION)))
+    {
         dbConnection.rollback();
         return false;
     }
@@ -145,22 +241,207 @@ bool DatabaseManager::createTables()
     // Commit transaction
     if (!dbConnection.commit())
     {
-        logger.log("Failed to commit transaction for table creation.");
+        LOG_ERROR(logger, "Failed to commit transaction for table creation.");
         dbConnection.rollback();
         return false;
     }
 
-    logger.log("Created all tables successfully.");
+    LOG_INFO(logger, "Created all tables successfully.");
 
     return true;
 }
 
+int DatabaseManager::schemaVersion()
+{
+    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
+    QSqlQuery versionQuery(dbConnection);
+    if (!versionQuery.exec("PRAGMA user_version;") || !versionQuery.next())
+    {
+        LOG_ERROR(logger, "Failed to read the schema version.");
+        return -1;
+    }
+    return versionQuery.value(0).toInt();
+}
+
+bool DatabaseManager::migrateSchema()
+{
+    int version = schemaVersion();
+    if (version < 0)
+    {
+        return false;
+    }
+
+    // Version 1: money is stored as INTEGER minor units instead of REAL
+    if (version < 1 && !runMigration(1, QStringList()
+        << "CREATE TABLE Users_Personal_Data_v1 (AccountNumber INTEGER PRIMARY KEY, Name TEXT,"
+           " Age INTEGER CHECK(Age >= 18 AND Age <= 120), Balance INTEGER NOT NULL DEFAULT 0,"
+           " FOREIGN KEY(AccountNumber) REFERENCES Accounts(AccountNumber));"
+        << "INSERT INTO Users_Personal_Data_v1 (AccountNumber, Name, Age, Balance)"
+           " SELECT AccountNumber, Name, Age, CAST(ROUND(COALESCE(Balance, 0) * 100) AS INTEGER)"
+           " FROM Users_Personal_Data;"
+        << "DROP TABLE Users_Personal_Data;"
+        << "ALTER TABLE Users_Personal_Data_v1 RENAME TO Users_Personal_Data;"
+        << "CREATE TABLE Transaction_History_v1 (TransactionID INTEGER PRIMARY KEY AUTOINCREMENT,"
+           " AccountNumber INTEGER, Date TEXT, Time TEXT, Amount INTEGER NOT NULL,"
+           " FOREIGN KEY(AccountNumber) REFERENCES Accounts(AccountNumber));"
+        << "INSERT INTO Transaction_History_v1 (TransactionID, AccountNumber, Date, Time, Amount)"
+           " SELECT TransactionID, AccountNumber, Date, Time,"
+           " CAST(ROUND(COALESCE(Amount, 0) * 100) AS INTEGER) FROM Transaction_History;"
+        // IDs of deleted history rows must not be handed out again
+        << "UPDATE sqlite_sequence SET seq = (SELECT seq FROM sqlite_sequence"
+           " WHERE name = 'Transaction_History') WHERE name = 'Transaction_History_v1'"
+           " AND EXISTS (SELECT 1 FROM sqlite_sequence WHERE name = 'Transaction_History');"
+        << "DROP TABLE Transaction_History;"
+        << "ALTER TABLE Transaction_History_v1 RENAME TO Transaction_History;"))
+    {
+        return false;
+    }
+
+    // Version 2: sortable epoch seconds next to the dd-MM-yyyy Date text, indexed per account.
+    // Existing rows were written in server local time
+    if (version < 2 && !runMigration(2, QStringList()
+        << "ALTER TABLE Transaction_History ADD COLUMN Timestamp INTEGER NOT NULL DEFAULT 0;"
+        << "UPDATE Transaction_History SET Timestamp = COALESCE(CAST(strftime('%s',"
+           " substr(Date, 7, 4) || '-' || substr(Date, 4, 2) || '-' || substr(Date, 1, 2)"
+           " || ' ' || Time, 'utc') AS INTEGER), 0);"
+        << "CREATE INDEX IF NOT EXISTS Transaction_History_Account_Timestamp"
+           " ON Transaction_History (AccountNumber, Timestamp);"))
+    {
+        return false;
+    }
+
+    return true;
+}
+
+bool DatabaseManager::runMigration(int version, const QStringList &statements)
+{
+    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
+    QSqlQuery migrationQuery(dbConnection);
+
+    // Statements and the new user_version commit together or not at all
+    if (!dbConnection.transaction())
+    {
+        LOG_ERROR(logger, QString("Failed to start a transaction for schema version %1.").arg(version));
+        return false;
+    }
+
+    for (const QString &statement : statements)
+    {
+        if (!migrationQuery.exec(statement))
+        {
+            LOG_ERROR(logger, QString("Failed to migrate to schema version %1.").arg(version));
+            LOG_ERROR(logger, "Error: " + migrationQuery.lastError().text());
+            dbConnection.rollback();
+            return false;
+        }
+    }
+
+    if (!migrationQuery.exec(QString("PRAGMA user_version = %1;").arg(version)) ||
+        !dbConnection.commit())
+    {
+        LOG_ERROR(logger, QString("Failed to commit schema version %1.").arg(version));
+        dbConnection.rollback();
+        return false;
+    }
+
+    LOG_INFO(logger, QString("Migrated database to schema version %1.").arg(version));
+    return true;
+}
+
+bool DatabaseManager::ensureJournalState()
+{
+    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
+    QSqlQuery journalStateQuery(dbConnection);
+
+    if (!journalStateQuery.exec("CREATE TABLE IF NOT EXISTS Journal_State (Id INTEGER PRIMARY KEY"
+                                " CHECK(Id = 1), LastSequence INTEGER NOT NULL);") ||
+        !journalStateQuery.exec("INSERT OR IGNORE INTO Journal_State (Id, LastSequence)"
+                                " VALUES (1, 0);"))
+    {
+        LOG_ERROR(logger, "Failed to create the Journal_State table.");
+        LOG_ERROR(logger, "Error: " + journalStateQuery.lastError().text());
+        return false;
+    }
+    return true;
+}
+
+qint64 DatabaseManager::lastJournalSequence()
+{
+    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
+    QSqlQuery sequenceQuery(dbConnection);
+
+    if (!sequenceQuery.exec("SELECT LastSequence FROM Journal_State WHERE Id = 1;") ||
+        !sequenceQuery.next())
+    {
+        LOG_ERROR(logger, "Failed to read the last journal sequence.");
+        return -1;
+    }
+    return sequenceQuery.value(0).toLongLong();
+}
+
+void DatabaseManager::setJournalRecord(const QJsonObject &record)
+{
+    journalRecord = record;
+}
+
+qint64 DatabaseManager::stampJournalSequence()
+{
+    QSqlQuery *sequenceQuery;
+    if (journalRecord.contains("journalSequence"))
+    {
+        // Replay keeps the original numbering, gaps left by failed commits included
+        sequenceQuery = preparedQuery("UPDATE Journal_State SET LastSequence = ?"
+                                      " WHERE Id = 1 RETURNING LastSequence;");
+        if (sequenceQuery != nullptr)
+        {
+            sequenceQuery->bindValue(0, journalRecord["journalSequence"].toInteger());
+        }
+    }
+    else
+    {
+        sequenceQuery = preparedQuery("UPDATE Journal_State SET LastSequence = LastSequence + 1"
+                                      " WHERE Id = 1 RETURNING LastSequence;");
+    }
+    if (sequenceQuery == nullptr)
+    {
+        return -1;
+    }
+
+    qint64 sequence = -1;
+    if (sequenceQuery->exec() && sequenceQuery->next())
+    {
+        sequence = sequenceQuery->value(0).toLongLong();
+    }
+    else
+    {
+        LOG_ERROR(logger, "Failed to stamp the journal sequence.");
+        LOG_ERROR(logger, "Error: " + sequenceQuery->lastError().text());
+    }
+    sequenceQuery->finish();
+    return sequence;
+}
+
 bool DatabaseManager::startDatabaseTransaction()
 {
     QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
     if (!dbConnection.transaction())
     {
-        logger.log("Failed to start a database transaction.");
+        LOG_ERROR(logger, "Failed to start a database transaction.");
+        return false;
+    }
+    return true;
+}
+
+bool DatabaseManager::startImmediateTransaction()
+{
+    // A deferred transaction that reads first can fail with SQLITE_BUSY when it tries to write,
+    // taking the lock at BEGIN makes busy_timeout apply instead
+    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
+    QSqlQuery beginQuery(dbConnection);
+    if (!beginQuery.exec("BEGIN IMMEDIATE"))
+    {
+        LOG_ERROR(logger, "Failed to start an immediate database transaction.");
+        LOG_ERROR(logger, "Error: " + beginQuery.lastError().text());
         return false;
     }
     return true;
@@ -169,11 +450,40 @@ bool DatabaseManager::startDatabaseTransaction()
 bool DatabaseManager::commitDatabaseTransaction()
 {
     QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
+
+    // Numbered inside the transaction, under the write lock, so sequence order is commit order
+    // and every backup knows which journal records it already contains
+    qint64 journalSequence = 0;
+    if (!journalRecord.isEmpty())
+    {
+        // Nothing is committed that the journal could not record
+        if (TransactionJournal::instance()->hasFailed())
+        {
+            LOG_ERROR(logger, "The transaction journal failed, the transaction is not committed.");
+            return false;
+        }
+        journalSequence = stampJournalSequence();
+        if (journalSequence <= 0)
+        {
+            return false;
+        }
+    }
+
     if (!dbConnection.commit())
     {
-        logger.log("Failed to commit database transaction.");
+        LOG_ERROR(logger, "Failed to commit database transaction.");
         return false;
     }
+
+    if (journalSequence > 0 && !journalRecord.contains("journalSequence") &&
+        !TransactionJournal::instance()->append(journalSequence, journalRecord))
+    {
+        // Committed to the database but not durable in the journal, never acknowledged
+        LOG_ERROR(logger, QString("Failed to journal operation %1.").arg(journalSequence));
+        journalRecord = QJsonObject();
+        return false;
+    }
+    journalRecord = QJsonObject();
     return true;
 }
 
@@ -182,7 +492,7 @@ bool DatabaseManager::rollbackDatabaseTransaction()
     QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
     if (!dbConnection.rollback())
     {
-        logger.log("Failed to rollback database transaction.");
+        LOG_ERROR(logger, "Failed to rollback database transaction.");
         return false;
     }
     return true;
@@ -192,138 +502,284 @@ QVariant DatabaseManager::fetchData(const QString &tableName,
                                     const QString &fieldName,
                                     const QJsonObject &searchCriteria)
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-    QSqlQuery fetchQuery(dbConnection);
+    QStringList criteriaKeys = searchCriteria.keys();
+    QString cacheKey = QString("SELECT|%1|%2|%3").
+                       arg(tableName, fieldName, criteriaKeys.join(','));
 
-    QStringList criteriaList;
-    for (auto it = searchCriteria.begin(); it != searchCriteria.end(); ++it)
+    QSqlQuery *fetchQuery = findPreparedQuery(cacheKey);
+    if (fetchQuery == nullptr)
     {
-        criteriaList.append(QString("%1 = ?").arg(it.key()));
-    }
-    QString criteriaString = criteriaList.join(" AND ");
+        QStringList criteriaList;
+        for (const QString &key : criteriaKeys)
+        {
+            criteriaList.append(QString("%1 = ?").arg(key));
+        }
+        QString criteriaString = criteriaList.join(" AND ");
 
-    fetchQuery.prepare(QString("SELECT %1 FROM %2 WHERE %3").
-                       arg(fieldName, tableName, criteriaString));
+        fetchQuery = addPreparedQuery(cacheKey, QString("SELECT %1 FROM %2 WHERE %3").
+                                                arg(fieldName, tableName, criteriaString));
+        if (fetchQuery == nullptr)
+        {
+            return QVariant();
+        }
+    }
 
-    for (auto it = searchCriteria.begin(); it != searchCriteria.end(); ++it)
+    for (int i = 0; i < criteriaKeys.size(); ++i)
     {
-        fetchQuery.addBindValue(it.value().toVariant());
+        fetchQuery->bindValue(i, searchCriteria[criteriaKeys.at(i)].toVariant());
     }
 
-    if (!fetchQuery.exec())
+    if (!fetchQuery->exec())
     {
-        logger.log("Failed to fetch data from the database.");
-        logger.log("Error: " + fetchQuery.lastError().text());
+        LOG_ERROR(logger, "Failed to fetch data from the database.");
+        LOG_ERROR(logger, "Error: " + fetchQuery->lastError().text());
+        fetchQuery->finish();
         return QVariant();
     }
 
-    if (fetchQuery.next())
+    QVariant result;
+    if (fetchQuery->next())
+    {
+        result = fetchQuery->value(0);
+    }
+    // Reset the statement so it does not hold the read lock until its next use
+    fetchQuery->finish();
+
+    return result;
+}
+
+QSqlRecord DatabaseManager::fetchRow(const QString &tableName,
+                                    const QStringList &fieldNames,
+                                    const QJsonObject &searchCriteria)
+{
+    QStringList criteriaKeys = searchCriteria.keys();
+    QString fieldString = fieldNames.join(", ");
+    QString cacheKey = QString("SELECTROW|%1|%2|%3").
+                       arg(tableName, fieldString, criteriaKeys.join(','));
+
+    QSqlQuery *fetchQuery = findPreparedQuery(cacheKey);
+    if (fetchQuery == nullptr)
+    {
+        QStringList criteriaList;
+        for (const QString &key : criteriaKeys)
+        {
+            criteriaList.append(QString("%1 = ?").arg(key));
+        }
+        QString criteriaString = criteriaList.join(" AND ");
+
+        fetchQuery = addPreparedQuery(cacheKey, QString("SELECT %1 FROM %2 WHERE %3 LIMIT 1").
+                                                arg(fieldString, tableName, criteriaString));
+        if (fetchQuery == nullptr)
+        {
+            return QSqlRecord();
+        }
+    }
+
+    for (int i = 0; i < criteriaKeys.size(); ++i)
+    {
+        fetchQuery->bindValue(i, searchCriteria[criteriaKeys.at(i)].toVariant());
+    }
+
+    if (!fetchQuery->exec())
+    {
+        LOG_ERROR(logger, "Failed to fetch row from the database.");
+        LOG_ERROR(logger, "Error: " + fetchQuery->lastError().text());
+        fetchQuery->finish();
+        return QSqlRecord();
+    }
+
+    QSqlRecord result;
+    if (fetchQuery->next())
     {
-        return fetchQuery.value(0);
+        result = fetchQuery->record();
     }
+    fetchQuery->finish();
 
-    return QVariant();
+    return result;
 }
 
 qint64 DatabaseManager::insertData(const QString &tableName,
                                    const QJsonObject &data)
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-    QSqlQuery insertQuery(dbConnection);
-
     QStringList keys = data.keys();
-    QString fields = keys.join(",");
+    QString cacheKey = QString("INSERT|%1|%2").arg(tableName, keys.join(','));
+
+    QSqlQuery *insertQuery = findPreparedQuery(cacheKey);
+    if (insertQuery == nullptr)
+    {
+        QString fields = keys.join(",");
 
-    // Use a static QRegularExpression object to not load it every single call
-    static const QRegularExpression re("[^,]+");
-    QString placeholders = keys.join(",").replace(re, "?");
+        // Use a static QRegularExpression object to not load it every single call
+        static const QRegularExpression re("[^,]+");
+        QString placeholders = keys.join(",").replace(re, "?");
 
-    insertQuery.prepare(QString("INSERT INTO %1 (%2) VALUES (%3)").
-                        arg(tableName, fields, placeholders));
+        insertQuery = addPreparedQuery(cacheKey, QString("INSERT INTO %1 (%2) VALUES (%3)").
+                                                 arg(tableName, fields, placeholders));
+        if (insertQuery == nullptr)
+        {
+            return 0;
+        }
+    }
 
-    foreach (const QString &key, keys)
+    for (int i = 0; i < keys.size(); ++i)
     {
-        insertQuery.addBindValue(data[key].toVariant());
+        insertQuery->bindValue(i, data[keys.at(i)].toVariant());
     }
 
-    if (!insertQuery.exec())
+    if (!insertQuery->exec())
     {
-        logger.log("Failed to insert data into the database.");
-        logger.log("Error: " + insertQuery.lastError().text());
+        LOG_ERROR(logger, "Failed to insert data into the database.");
+        LOG_ERROR(logger, "Error: " + insertQuery->lastError().text());
+        insertQuery->finish();
         return 0;
     }
 
-    return insertQuery.lastInsertId().toLongLong();
+    qint64 insertId = insertQuery->lastInsertId().toLongLong();
+    insertQuery->finish();
+    return insertId;
 }
 
 bool DatabaseManager::updateData(const QString &tableName,
                                  const QJsonObject &data,
                                  const QJsonObject &searchCriteria)
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-    QSqlQuery updateQuery(dbConnection);
-
     QStringList keys = data.keys();
-    QString setStatement = keys.join("=?,") + "=?";
-
     QStringList criteriaKeys = searchCriteria.keys();
-    QStringList criteriaList;
-    for (const QString &key : criteriaKeys)
+    QString cacheKey = QString("UPDATE|%1|%2|%3").
+                       arg(tableName, keys.join(','), criteriaKeys.join(','));
+
+    QSqlQuery *updateQuery = findPreparedQuery(cacheKey);
+    if (updateQuery == nullptr)
     {
-        criteriaList.append(QString("%1 = ?").arg(key));
-    }
-    QString criteriaString = criteriaList.join(" AND ");
+        QString setStatement = keys.join("=?,") + "=?";
+
+        QStringList criteriaList;
+        for (const QString &key : criteriaKeys)
+        {
+            criteriaList.append(QString("%1 = ?").arg(key));
+        }
+        QString criteriaString = criteriaList.join(" AND ");
 
-    updateQuery.prepare(QString("UPDATE %1 SET %2 WHERE %3").
-                        arg(tableName, setStatement, criteriaString));
+        updateQuery = addPreparedQuery(cacheKey, QString("UPDATE %1 SET %2 WHERE %3").
+                                                 arg(tableName, setStatement, criteriaString));
+        if (updateQuery == nullptr)
+        {
+            return false;
+        }
+    }
 
-    foreach (const QString &key, keys)
+    int bindIndex = 0;
+    for (const QString &key : keys)
     {
-        updateQuery.addBindValue(data[key].toVariant());
+        updateQuery->bindValue(bindIndex++, data[key].toVariant());
     }
-    foreach (const QString &key, criteriaKeys)
+    for (const QString &key : criteriaKeys)
     {
-        updateQuery.addBindValue(searchCriteria[key].toVariant());
+        updateQuery->bindValue(bindIndex++, searchCriteria[key].toVariant());
     }
 
-    if (!updateQuery.exec())
+    if (!updateQuery->exec())
     {
-        logger.log("Failed to update data in the database.");
-        logger.log("Error: " + updateQuery.lastError().text());
+        LOG_ERROR(logger, "Failed to update data in the database.");
+        LOG_ERROR(logger, "Error: " + updateQuery->lastError().text());
+        updateQuery->finish();
         return false;
     }
 
+    updateQuery->finish();
     return true;
 }
 
 bool DatabaseManager::removeData(const QString &tableName,
                                  const QJsonObject &searchCriteria)
 {
-    QSqlDatabase dbConnection = QSqlDatabase::database(connectionName);
-    QSqlQuery removeQuery(dbConnection);
-
     QStringList criteriaKeys = searchCriteria.keys();
-    QStringList criteriaList;
-    for (const QString &key : criteriaKeys)
+    QString cacheKey = QString("DELETE|%1|%2").arg(tableName, criteriaKeys.join(','));
+
+    QSqlQuery *removeQuery = findPreparedQuery(cacheKey);
+    if (removeQuery == nullptr)
     {
-        criteriaList.append(QString("%1 = ?").arg(key));
-    }
-    QString criteriaString = criteriaList.join(" AND ");
+        QStringList criteriaList;
+        for (const QString &key : criteriaKeys)
+        {
+            criteriaList.append(QString("%1 = ?").arg(key));
+        }
+        QString criteriaString = criteriaList.join(" AND ");
 
-    removeQuery.prepare(QString("DELETE FROM %1 WHERE %2").
-                        arg(tableName, criteriaString));
+        removeQuery = addPreparedQuery(cacheKey, QString("DELETE FROM %1 WHERE %2").
+                                                 arg(tableName, criteriaString));
+        if (removeQuery == nullptr)
+        {
+            return false;
+        }
+    }
 
-    foreach (const QString &key, criteriaKeys)
+    for (int i = 0; i < criteriaKeys.size(); ++i)
     {
-        removeQuery.addBindValue(searchCriteria[key].toVariant());
+        removeQuery->bindValue(i, searchCriteria[criteriaKeys.at(i)].toVariant());
     }
 
-    if (!removeQuery.exec())
+    if (!removeQuery->exec())
     {
-        logger.log("Failed to remove data from the database.");
-        logger.log("Error: " + removeQuery.lastError().text());
+        LOG_ERROR(logger, "Failed to remove data from the database.");
+        LOG_ERROR(logger, "Error: " + removeQuery->lastError().text());
+        removeQuery->finish();
         return false;
     }
 
+    removeQuery->finish();
     return true;
 }
+
+QSqlQuery *DatabaseManager::preparedQuery(const QString &sql)
+{
+    QSqlQuery *query = findPreparedQuery(sql);
+    if (query == nullptr)
+    {
+        query = addPreparedQuery(sql, sql);
+    }
+    return query;
+}
+
+quint64 DatabaseManager::preparedCacheHits() const
+{
+    return cacheHits;
+}
+
+quint64 DatabaseManager::preparedCacheMisses() const
+{
+    return cacheMisses;
+}
+
+QSqlQuery *DatabaseManager::findPreparedQuery(const QString &cacheKey)
+{
+    QSqlQuery *query = preparedQueries.value(cacheKey, nullptr);
+    if (query != nullptr)
+    {
+        cacheHits++;
+    }
+    return query;
+}
+
+QSqlQuery *DatabaseManager::addPreparedQuery(const QString &cacheKey, const QString &sql)
+{
+    cacheMisses++;
+
+    QSqlQuery *query = new QSqlQuery(QSqlDatabase::database(connectionName));
+    if (!query->prepare(sql))
+    {
+        LOG_ERROR(logger, "Failed to prepare statement: " + sql);
+        LOG_ERROR(logger, "Error: " + query->lastError().text());
+        delete query;
+        return nullptr;
+    }
+
+    preparedQueries.insert(cacheKey, query);
+    return query;
+}
+
+void DatabaseManager::clearPreparedQueries()
+{
+    qDeleteAll(preparedQueries);
+    preparedQueries.clear();
+}
@@ -4,6 +4,7 @@
 #include <QSqlDatabase>
 #include <QSqlQuery>
 #include <QSqlError>
+#include <QSqlRecord>
 #include <QObject>
 #include <QFile>
 #include <QJsonDocument>
@@ -11,9 +12,17 @@
 #include <QJsonArray>
 #include <QDateTime>
 #include <QRegularExpression>
+#include <QHash>
+#include <QList>
+#include <QPair>
 
+#include "TransactionJournal.h"
+#include "PasswordHasher.h"
 #include "Logger.h"
 
+// PRAGMA name and value pairs applied in order every time a connection is opened
+typedef QList<QPair<QString, QString>> PragmaProfile;
+
 class DatabaseManager : public QObject
 {
     Q_OBJECT
@@ -26,11 +35,26 @@ public:
     bool openConnection();
     void closeConnection();
     QSqlDatabase getDatabase();
+    QString getConnectionName() const;
+    // Points the connection at another file, used by the journal replay
+    void setDatabaseFileName(const QString &fileName);
     void initializeDatabase();
     bool createTables();
+    // Brings a database created by an older server up to the current schema
+    bool migrateSchema();
+    int schemaVersion();
+    // Single row table holding the journal sequence of the last committed operation
+    bool ensureJournalState();
+    qint64 lastJournalSequence();
+
+    // Operation journaled by the next commit, cleared by the caller after every request.
+    // A record that already carries a journalSequence is being replayed and is not journaled again.
+    void setJournalRecord(const QJsonObject &record);
 
     // Common database operations used in the industry
     bool startDatabaseTransaction();
+    // BEGIN IMMEDIATE, takes the write lock before the first statement runs
+    bool startImmediateTransaction();
     bool commitDatabaseTransaction();
     bool rollbackDatabaseTransaction();
 
@@ -38,6 +62,10 @@ public:
     QVariant fetchData(const QString &tableName,
                        const QString &fieldName,
                        const QJsonObject &searchCriteria);
+    // Several columns of the first matching row in one lookup, an empty record when none matches
+    QSqlRecord fetchRow(const QString &tableName,
+                        const QStringList &fieldNames,
+                        const QJsonObject &searchCriteria);
     qint64 insertData(const QString &tableName,
                       const QJsonObject &data);
     bool updateData(const QString &tableName,
@@ -46,9 +74,36 @@ public:
     bool removeData(const QString &tableName,
                     const QJsonObject &searchCriteria);
 
+    // Prepared statement for a fixed SQL text, prepared once per connection.
+    // Callers bind, exec and must finish() it before the next use.
+    QSqlQuery *preparedQuery(const QString &sql);
+
+    // Shared by every connection, set once at startup before connections are opened
+    static PragmaProfile defaultPragmaProfile();
+    static void setPragmaProfile(const PragmaProfile &profile);
+
+    // Prepared statement cache statistics
+    quint64 preparedCacheHits() const;
+    quint64 preparedCacheMisses() const;
+
 private:
     QString connectionName;
     Logger logger;
+
+    // Prepared statements keyed by operation, table, fields and criteria keys
+    QHash<QString, QSqlQuery*> preparedQueries;
+    QJsonObject journalRecord;
+    quint64 cacheHits = 0;
+    quint64 cacheMisses = 0;
+
+    static PragmaProfile pragmaProfile;
+
+    bool applyPragmaProfile();
+    bool runMigration(int version, const QStringList &statements);
+    qint64 stampJournalSequence();
+    QSqlQuery *findPreparedQuery(const QString &cacheKey);
+    QSqlQuery *addPreparedQuery(const QString &cacheKey, const QString &sql);
+    void clearPreparedQueries();
 };
 
 #endif // DATABASEMANAGER_H
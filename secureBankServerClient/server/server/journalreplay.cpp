@@ -0,0 +1,129 @@
+#include "JournalReplay.h"
+
+JournalReplay::JournalReplay(const QString &journalDirectory, QObject *parent)
+    : QObject(parent), journalDirectory(journalDirectory), logger("JournalReplay")
+{
+    LOG_DEBUG(logger, "JournalReplay Object Created.");
+}
+
+JournalReplay::~JournalReplay()
+{
+    LOG_DEBUG(logger, "JournalReplay Object Destroyed.");
+}
+
+QString JournalReplay::latestSnapshot() const
+{
+    // Full copies written before the chunk store, the last one by name is the newest
+    QDir backupDir("backup");
+    QStringList backups = backupDir.entryList(QStringList() << "backup_*.db", QDir::Files, QDir::Name);
+    if (backups.isEmpty())
+    {
+        return QString();
+    }
+    return backupDir.filePath(backups.last());
+}
+
+int JournalReplay::run(const QString &targetFileName)
+{
+    if (QFile::exists(targetFileName) && !QFile::remove(targetFileName))
+    {
+        LOG_ERROR(logger, "Failed to remove the old replay target: " + targetFileName);
+        return 1;
+    }
+
+    BackupChunkStore chunkStore;
+    QString snapshotFileName = chunkStore.latestManifest();
+    if (!snapshotFileName.isEmpty())
+    {
+        if (!chunkStore.restoreSnapshot(snapshotFileName, targetFileName))
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        snapshotFileName = latestSnapshot();
+        if (!snapshotFileName.isEmpty() && !QFile::copy(snapshotFileName, targetFileName))
+        {
+            LOG_ERROR(logger, "Failed to copy the snapshot: " + snapshotFileName);
+            return 1;
+        }
+    }
+
+    DatabaseManager databaseManager("JournalReplayConnection");
+    databaseManager.setDatabaseFileName(targetFileName);
+    if (!databaseManager.openConnection())
+    {
+        return 1;
+    }
+
+    // Without a backup the whole journal is replayed onto a new database
+    if (snapshotFileName.isEmpty())
+    {
+        LOG_INFO(logger, "No backup found, replaying onto an empty database.");
+        if (!databaseManager.createTables())
+        {
+            return 1;
+        }
+    }
+    else
+    {
+        LOG_INFO(logger, "Replaying onto backup " + snapshotFileName);
+        // Backups taken by an older server are upgraded before anything is applied
+        if (!databaseManager.ensureJournalState() || !databaseManager.migrateSchema())
+        {
+            return 1;
+        }
+    }
+
+    qint64 snapshotSequence = databaseManager.lastJournalSequence();
+    if (snapshotSequence < 0)
+    {
+        return 1;
+    }
+
+    QElapsedTimer readTimer;
+    readTimer.start();
+    QList<TransactionJournal::Entry> entries = TransactionJournal::readAll(journalDirectory);
+    // Records reach the journal right after their commit, the sequence is the commit order
+    std::sort(entries.begin(), entries.end(),
+              [](const TransactionJournal::Entry &first, const TransactionJournal::Entry &second)
+              {
+                  return first.sequence < second.sequence;
+              });
+    qint64 readMs = readTimer.elapsed();
+
+    RequestHandler requestHandler;
+    qint64 replayedOperations = 0;
+    QElapsedTimer replayTimer;
+    replayTimer.start();
+
+    for (const TransactionJournal::Entry &entry : entries)
+    {
+        if (entry.sequence <= snapshotSequence)
+        {
+            continue;
+        }
+        requestHandler.handleRequest(entry.record, &databaseManager, entry.sequence);
+        ++replayedOperations;
+    }
+
+    qint64 replayNs = replayTimer.nsecsElapsed();
+    double replayMinutes = replayNs / 60e9;
+    double mopsPerMinute = replayMinutes > 0 ? replayedOperations / replayMinutes / 1e6 : 0.0;
+
+    LOG_INFO(logger, QString("Read %1 journal records in %2 ms.").
+              arg(entries.size()).
+              arg(readMs));
+    LOG_INFO(logger, QString("Replayed %1 operations after sequence %2 in %3 ms (%4 Mops/min).").
+              arg(replayedOperations).
+              arg(snapshotSequence).
+              arg(replayNs / 1000000).
+              arg(mopsPerMinute, 0, 'f', 3));
+    LOG_INFO(logger, QString("Database rebuilt up to sequence %1 in %2").
+              arg(databaseManager.lastJournalSequence()).
+              arg(targetFileName));
+
+    databaseManager.closeConnection();
+    return 0;
+}
@@ -0,0 +1,36 @@
+#ifndef JOURNALREPLAY_H
+#define JOURNALREPLAY_H
+
+#include <QObject>
+#include <QDir>
+#include <QFile>
+#include <QElapsedTimer>
+#include <algorithm>
+
+#include "DatabaseManager.h"
+#include "RequestHandler.h"
+#include "TransactionJournal.h"
+#include "BackupChunkStore.h"
+#include "Logger.h"
+
+// Point in time recovery: the latest backup plus every journaled operation committed after it
+class JournalReplay : public QObject
+{
+    Q_OBJECT
+
+public:
+    JournalReplay(const QString &journalDirectory, QObject *parent = nullptr);
+    ~JournalReplay();
+
+    // Rebuilds the database into targetFileName and reports the replay speed.
+    // Returns the process exit code.
+    int run(const QString &targetFileName);
+
+private:
+    QString journalDirectory;
+    Logger logger;
+
+    QString latestSnapshot() const;
+};
+
+#endif // JOURNALREPLAY_H
@@ -1,5 +1,7 @@
 #include "Logger.h"
 
+QAtomicInt Logger::runtimeMinimumLevel(Logger::Debug);
+
 Logger::Logger(const QString &tag, QObject *parent)
     : QObject(parent), logTag(tag)
 {}
@@ -7,26 +9,67 @@ Logger::Logger(const QString &tag, QObject *parent)
 Logger::~Logger()
 {}
 
+void Logger::log(Level level, const QString &message)
+{
+    // Queued for the writer thread, never touches the disk on the caller's thread
+    LogSink::instance()->append(levelName(level), logTag, message);
+}
+
 void Logger::log(const QString &message)
 {
-    QMutexLocker locker(&mutex);
+    if (isEnabled(Info))
+    {
+        log(Info, message);
+    }
+}
 
-    QString logFilePath = "common_log.txt";
+void Logger::setMinimumLevel(Level level)
+{
+    runtimeMinimumLevel.storeRelaxed(level);
+}
 
-    logFile.setFileName(logFilePath);
+Logger::Level Logger::minimumLevel()
+{
+    return static_cast<Level>(runtimeMinimumLevel.loadRelaxed());
+}
 
-    if (logFile.open(QIODevice::WriteOnly | QIODevice::Append))
+Logger::Level Logger::levelFromName(const QString &name, Level defaultLevel)
+{
+    QString levelName = name.trimmed().toLower();
+
+    if (levelName == QLatin1String("debug"))
+    {
+        return Debug;
+    }
+    else if (levelName == QLatin1String("info"))
     {
-        textStream.setDevice(&logFile);
+        return Info;
     }
-    else
+    else if (levelName == QLatin1String("warning"))
+    {
+        return Warning;
+    }
+    else if (levelName == QLatin1String("error"))
+    {
+        return Error;
+    }
+
+    return defaultLevel;
+}
+
+QLatin1String Logger::levelName(Level level)
+{
+    switch (level)
     {
-        qDebug() << "Failed to open log file:" << logFilePath;
+    case Debug:
+        return QLatin1String("DEBUG");
+    case Info:
+        return QLatin1String("INFO");
+    case Warning:
+        return QLatin1String("WARNING");
+    case Error:
+        return QLatin1String("ERROR");
     }
-    QString formattedMessage = QString("%1: %2").arg(logTag, message);
-    textStream << formattedMessage << '\n';
-    textStream.flush();
-    logFile.close();
 
-    qDebug() << formattedMessage;
+    return QLatin1String("INFO");
 }
@@ -2,26 +2,68 @@
 #define LOGGER_H
 
 #include <QObject>
-#include <QFile>
-#include <QTextStream>
-#include <QMutex>
-#include <QDebug>
+#include <QString>
+#include <QAtomicInt>
 
+#include "LogSink.h"
+
+// Lowest level compiled into the binary, DEFINES += LOG_COMPILE_MIN_LEVEL=1 drops every debug message
+#ifndef LOG_COMPILE_MIN_LEVEL
+#define LOG_COMPILE_MIN_LEVEL 0
+#endif
+
+// The message expression is only evaluated when the level is enabled,
+// a disabled message costs one comparison and no formatting or allocation
+#define LOG_AT(logger, level, message) \
+    do \
+    { \
+        if ((level) >= LOG_COMPILE_MIN_LEVEL && Logger::isEnabled(level)) \
+        { \
+            (logger).log((level), (message)); \
+        } \
+    } while (false)
+
+#define LOG_DEBUG(logger, message) LOG_AT(logger, Logger::Debug, message)
+#define LOG_INFO(logger, message) LOG_AT(logger, Logger::Info, message)
+#define LOG_WARNING(logger, message) LOG_AT(logger, Logger::Warning, message)
+#define LOG_ERROR(logger, message) LOG_AT(logger, Logger::Error, message)
+
+// Cheap per component tag, every line goes to the process wide LogSink
 class Logger : public QObject
 {
     Q_OBJECT
 
 public:
+    enum Level
+    {
+        Debug = 0,
+        Info = 1,
+        Warning = 2,
+        Error = 3
+    };
+
     Logger(const QString &tag, QObject *parent = nullptr);
     ~Logger();
 
+    // Prefer the LOG_* macros, they skip building the message when the level is disabled
+    void log(Level level, const QString &message);
     void log(const QString &message);
 
+    // Runtime threshold shared by every logger, messages below it are dropped
+    static void setMinimumLevel(Level level);
+    static Level minimumLevel();
+    static bool isEnabled(Level level)
+    {
+        return level >= runtimeMinimumLevel.loadRelaxed();
+    }
+
+    static Level levelFromName(const QString &name, Level defaultLevel);
+    static QLatin1String levelName(Level level);
+
 private:
-    QFile logFile;
-    QTextStream textStream;
     QString logTag;
-    QMutex mutex;
+
+    static QAtomicInt runtimeMinimumLevel;
 };
 
 #endif // LOGGER_H
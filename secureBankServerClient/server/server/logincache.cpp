@@ -0,0 +1,121 @@
+#include "LoginCache.h"
+
+LoginCache *LoginCache::instance()
+{
+    static LoginCache *cache = new LoginCache();
+    return cache;
+}
+
+LoginCache::LoginCache()
+    : entries(1024)
+{
+    digestKey.resize(32);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32 *>(digestKey.data()),
+                                          digestKey.size() / sizeof(quint32));
+}
+
+void LoginCache::setOptions(int maxPrincipals, int maxAgeSeconds)
+{
+    QMutexLocker locker(&mutex);
+    entries.setMaxCost(qMax(0, maxPrincipals));
+    this->maxAgeSeconds = maxAgeSeconds;
+}
+
+QString LoginCache::cacheKey(const QString &username)
+{
+    // Usernames are COLLATE NOCASE, which folds ASCII letters only
+    QString key = username;
+    for (QChar &character : key)
+    {
+        if (character >= QLatin1Char('A') && character <= QLatin1Char('Z'))
+        {
+            character = QChar(character.unicode() + ('a' - 'A'));
+        }
+    }
+    return key;
+}
+
+bool LoginCache::authenticate(const QString &name, const QString &password, Principal *principal)
+{
+    QString username = cacheKey(name);
+    QByteArray digest = credentialDigest(username, password);
+
+    QMutexLocker locker(&mutex);
+    // object() also marks the entry as the most recently used
+    Entry *entry = entries.object(username);
+    if (entry == nullptr)
+    {
+        return false;
+    }
+    if (entry->expiry.hasExpired())
+    {
+        entries.remove(username);
+        return false;
+    }
+
+    if (!PasswordHasher::constantTimeEquals(entry->credentialDigest, digest))
+    {
+        return false;
+    }
+
+    *principal = entry->principal;
+    return true;
+}
+
+quint64 LoginCache::generation()
+{
+    QMutexLocker locker(&mutex);
+    return removals;
+}
+
+void LoginCache::insert(const QString &name, const QString &password, const Principal &principal,
+                        quint64 generation)
+{
+    QString username = cacheKey(name);
+    Entry *entry = new Entry;
+    entry->credentialDigest = credentialDigest(username, password);
+    entry->principal = principal;
+
+    QMutexLocker locker(&mutex);
+    if (generation != removals)
+    {
+        delete entry;
+        return;
+    }
+    entry->expiry = QDeadlineTimer(qint64(maxAgeSeconds) * 1000);
+    // Takes ownership, deletes the entry right away when the cache is disabled
+    entries.insert(username, entry);
+}
+
+void LoginCache::remove(const QString &username)
+{
+    QMutexLocker locker(&mutex);
+    removals++;
+    entries.remove(cacheKey(username));
+}
+
+void LoginCache::removeAccount(qint64 accountNumber)
+{
+    QMutexLocker locker(&mutex);
+    removals++;
+    const QList<QString> usernames = entries.keys();
+    for (const QString &username : usernames)
+    {
+        Entry *entry = entries.object(username);
+        if (entry != nullptr && entry->principal.accountNumber == accountNumber)
+        {
+            entries.remove(username);
+        }
+    }
+}
+
+QByteArray LoginCache::credentialDigest(const QString &username, const QString &password) const
+{
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(digestKey);
+    hash.addData(username.toUtf8());
+    // Separator, so user "ab" with password "c" differs from user "a" with password "bc"
+    hash.addData(QByteArrayView("\0", 1));
+    hash.addData(password.toUtf8());
+    return hash.result();
+}
@@ -0,0 +1,63 @@
+#ifndef LOGINCACHE_H
+#define LOGINCACHE_H
+
+#include <QString>
+#include <QByteArray>
+#include <QCache>
+#include <QMutex>
+#include <QDeadlineTimer>
+#include <QCryptographicHash>
+#include <QRandomGenerator>
+
+#include "PasswordHasher.h"
+
+// Bounded LRU of recently authenticated users, shared by every worker thread.
+// A client that reconnects after an idle disconnect logs in again without a database lookup.
+// Passwords are never kept, only a digest salted with a key generated at startup.
+class LoginCache
+{
+public:
+    struct Principal
+    {
+        qint64 accountNumber = 0;
+        bool isAdmin = false;
+    };
+
+    static LoginCache *instance();
+
+    // maxPrincipals 0 disables the cache
+    void setOptions(int maxPrincipals, int maxAgeSeconds);
+
+    // True when the user logged in with this password recently
+    bool authenticate(const QString &username, const QString &password, Principal *principal);
+    // Taken before the credentials are read from the database, the insert is skipped
+    // when credentials changed in between
+    quint64 generation();
+    void insert(const QString &username, const QString &password, const Principal &principal,
+                quint64 generation);
+
+    // Called when the credentials change or the account is deleted
+    void remove(const QString &username);
+    void removeAccount(qint64 accountNumber);
+
+private:
+    LoginCache();
+
+    struct Entry
+    {
+        QByteArray credentialDigest;
+        Principal principal;
+        QDeadlineTimer expiry;
+    };
+
+    static QString cacheKey(const QString &username);
+    QByteArray credentialDigest(const QString &username, const QString &password) const;
+
+    QMutex mutex;
+    QCache<QString, Entry> entries;
+    QByteArray digestKey;
+    int maxAgeSeconds = 300;
+    quint64 removals = 0;
+};
+
+#endif // LOGINCACHE_H
@@ -0,0 +1,501 @@
+#include "LogSink.h"
+
+// Encodes UTF-16 straight into the batch, no temporary QByteArray per record
+static void appendUtf8(QByteArray &out, const QString &text, bool escapeJson)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    const QChar *chars = text.constData();
+    const qsizetype length = text.size();
+
+    for (qsizetype i = 0; i < length; ++i)
+    {
+        char16_t unit = chars[i].unicode();
+        if (unit < 0x80)
+        {
+            if (escapeJson && (unit == '"' || unit == '\\'))
+            {
+                out.append('\\');
+                out.append(char(unit));
+            }
+            else if (escapeJson && unit < 0x20)
+            {
+                out.append("\\u00", 4);
+                out.append(hexDigits[unit >> 4]);
+                out.append(hexDigits[unit & 0x0F]);
+            }
+            else
+            {
+                out.append(char(unit));
+            }
+        }
+        else if (unit < 0x800)
+        {
+            out.append(char(0xC0 | (unit >> 6)));
+            out.append(char(0x80 | (unit & 0x3F)));
+        }
+        else if (QChar::isHighSurrogate(unit) && i + 1 < length &&
+                 QChar::isLowSurrogate(chars[i + 1].unicode()))
+        {
+            char32_t codePoint = QChar::surrogateToUcs4(unit, chars[i + 1].unicode());
+            ++i;
+            out.append(char(0xF0 | (codePoint >> 18)));
+            out.append(char(0x80 | ((codePoint >> 12) & 0x3F)));
+            out.append(char(0x80 | ((codePoint >> 6) & 0x3F)));
+            out.append(char(0x80 | (codePoint & 0x3F)));
+        }
+        else
+        {
+            // Lone surrogates become U+FFFD
+            if (QChar::isSurrogate(unit))
+            {
+                unit = 0xFFFD;
+            }
+            out.append(char(0xE0 | (unit >> 12)));
+            out.append(char(0x80 | ((unit >> 6) & 0x3F)));
+            out.append(char(0x80 | (unit & 0x3F)));
+        }
+    }
+}
+
+static void appendNumber(QByteArray &out, qint64 value)
+{
+    char digits[24];
+    int count = 0;
+    quint64 magnitude = value < 0 ? quint64(0) - quint64(value) : quint64(value);
+
+    do
+    {
+        digits[count++] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude != 0);
+
+    if (value < 0)
+    {
+        out.append('-');
+    }
+    while (count > 0)
+    {
+        out.append(digits[--count]);
+    }
+}
+
+LogContextScope::LogContextScope(qintptr socketDescriptor, int requestId, qint64 correlationId)
+    : previousContext(LogSink::currentContext())
+{
+    LogContext &context = LogSink::currentContext();
+    context.socketDescriptor = socketDescriptor;
+    context.requestId = requestId;
+    context.correlationId = correlationId;
+    context.startNs = LogSink::monotonicNs();
+}
+
+LogContextScope::~LogContextScope()
+{
+    LogSink::currentContext() = previousContext;
+}
+
+qint64 LogContextScope::elapsedUs() const
+{
+    return (LogSink::monotonicNs() - LogSink::currentContext().startNs) / 1000;
+}
+
+LogSink *LogSink::instance()
+{
+    // Never destroyed, Loggers may still be used while statics are torn down
+    static LogSink *sink = new LogSink();
+    return sink;
+}
+
+LogSink::LogSink()
+    : head(&stub), tail(&stub)
+{
+    // Start the monotonic clock before the first record
+    monotonicNs();
+}
+
+LogSink::~LogSink()
+{
+    stop();
+}
+
+void LogSink::start(const Options &options)
+{
+    if (running.load(std::memory_order_acquire))
+    {
+        return;
+    }
+
+    this->options = options;
+    logFile.setFileName(options.fileName);
+    openLogFile();
+
+    running.store(true, std::memory_order_release);
+    writerThread = QThread::create([this]() { writerLoop(); });
+    writerThread->setObjectName("LogWriter");
+    writerThread->start(QThread::LowPriority);
+}
+
+void LogSink::stop()
+{
+    if (!running.exchange(false, std::memory_order_acq_rel))
+    {
+        return;
+    }
+
+    wakeUp.release();
+    writerThread->wait();
+    delete writerThread;
+    writerThread = nullptr;
+
+    // Lines pushed while the writer was finishing
+    stopped.store(true, std::memory_order_release);
+    QByteArray batch;
+    drainQueue(batch);
+    writeBatch(batch);
+    logFile.close();
+}
+
+void LogSink::append(QLatin1String level, const QString &tag, const QString &message)
+{
+    if (stopped.load(std::memory_order_acquire))
+    {
+        // The writer is gone, keep the line visible at least
+        qDebug().noquote() << tag + QLatin1String(": ") + message;
+        return;
+    }
+
+    // The strings are implicitly shared, the record only holds references
+    LogRecord *record = new LogRecord;
+    record->timestampNs = monotonicNs();
+    record->threadId = quintptr(QThread::currentThreadId());
+    record->threadName = QThread::currentThread()->objectName();
+    record->level = level;
+    record->tag = tag;
+    record->message = message;
+    record->context = currentContext();
+    push(record);
+
+    // Wake the writer early only when a full batch is waiting
+    int pending = pendingCount.fetch_add(1, std::memory_order_relaxed) + 1;
+    if (pending == 256)
+    {
+        wakeUp.release();
+    }
+}
+
+void LogSink::push(LogRecord *record)
+{
+    record->next.store(nullptr, std::memory_order_relaxed);
+    LogRecord *previous = head.exchange(record, std::memory_order_acq_rel);
+    previous->next.store(record, std::memory_order_release);
+}
+
+LogSink::LogRecord *LogSink::pop()
+{
+    LogRecord *first = tail;
+    LogRecord *next = first->next.load(std::memory_order_acquire);
+
+    if (first == &stub)
+    {
+        if (next == nullptr)
+        {
+            return nullptr;
+        }
+        tail = next;
+        first = next;
+        next = next->next.load(std::memory_order_acquire);
+    }
+
+    if (next != nullptr)
+    {
+        tail = next;
+        return first;
+    }
+
+    // A producer swapped head but has not linked its record yet
+    if (first != head.load(std::memory_order_acquire))
+    {
+        return nullptr;
+    }
+
+    push(&stub);
+    next = first->next.load(std::memory_order_acquire);
+    if (next != nullptr)
+    {
+        tail = next;
+        return first;
+    }
+    return nullptr;
+}
+
+void LogSink::writerLoop()
+{
+    QByteArray batch;
+    batch.reserve(options.flushBytes * 2);
+    QElapsedTimer sinceFlush;
+    sinceFlush.start();
+
+    while (running.load(std::memory_order_acquire))
+    {
+        wakeUp.tryAcquire(1, options.flushIntervalMs);
+        drainQueue(batch);
+
+        if (batch.size() >= options.flushBytes ||
+            (!batch.isEmpty() && sinceFlush.elapsed() >= options.flushIntervalMs))
+        {
+            writeBatch(batch);
+            sinceFlush.restart();
+        }
+    }
+
+    drainQueue(batch);
+    writeBatch(batch);
+}
+
+void LogSink::drainQueue(QByteArray &batch)
+{
+    while (LogRecord *record = pop())
+    {
+        qsizetype lineStart = batch.size();
+        if (options.format == JsonLines)
+        {
+            formatJson(record, batch);
+        }
+        else
+        {
+            formatText(record, batch);
+        }
+        if (options.echoToConsole)
+        {
+            qDebug().noquote() << QString::fromUtf8(batch.constData() + lineStart,
+                                                    batch.size() - lineStart);
+        }
+        batch.append('\n');
+        delete record;
+        pendingCount.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+void LogSink::writeBatch(QByteArray &batch)
+{
+    if (batch.isEmpty())
+    {
+        return;
+    }
+    if (logFile.isOpen())
+    {
+        logFile.write(batch);
+        logFile.flush();
+        segmentBytes += batch.size();
+    }
+    // Keep the capacity for the next batch
+    batch.resize(0);
+
+    rotateIfNeeded();
+}
+
+bool LogSink::openLogFile()
+{
+    if (!logFile.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        qDebug() << "Failed to open log file:" << options.fileName;
+        return false;
+    }
+
+    // An oversized file left by a previous run is rotated on the first flush
+    segmentBytes = logFile.size();
+    segmentAge.start();
+    return true;
+}
+
+void LogSink::rotateIfNeeded()
+{
+    bool tooLarge = options.maxFileBytes > 0 && segmentBytes >= options.maxFileBytes;
+    bool tooOld = options.rotateIntervalHours > 0 &&
+                  segmentAge.isValid() &&
+                  segmentAge.elapsed() >= qint64(options.rotateIntervalHours) * 60 * 60 * 1000;
+
+    if (tooLarge || (tooOld && segmentBytes > 0))
+    {
+        rotate();
+    }
+}
+
+void LogSink::rotate()
+{
+    logFile.close();
+
+    // Timestamped names sort oldest first and never collide with a segment still being compressed
+    QString baseName = options.fileName + QLatin1Char('.') +
+                       QDateTime::currentDateTime().toString("yyyyMMdd-HHmmss");
+    QString segmentName = baseName;
+    for (int suffix = 1; QFile::exists(segmentName) ||
+                         QFile::exists(segmentName + QLatin1String(".qz")); ++suffix)
+    {
+        segmentName = baseName + QLatin1Char('-') + QString::number(suffix);
+    }
+
+    if (!QFile::rename(options.fileName, segmentName))
+    {
+        qDebug() << "Failed to rotate log file:" << options.fileName;
+        segmentName.clear();
+    }
+
+    openLogFile();
+
+    if (!segmentName.isEmpty() && options.compressRotated)
+    {
+        QThreadPool::globalInstance()->start([segmentName]() { compressSegment(segmentName); });
+    }
+    pruneSegments();
+}
+
+void LogSink::pruneSegments()
+{
+    QFileInfo logInfo(options.fileName);
+    QDir logDir = logInfo.absoluteDir();
+    QString prefix = logInfo.fileName() + QLatin1Char('.');
+
+    // A segment may exist as plain text, compressed, or briefly both
+    QStringList segments;
+    const QStringList entries = logDir.entryList(QStringList() << prefix + QLatin1Char('*'),
+                                                 QDir::Files, QDir::Name);
+    for (const QString &entry : entries)
+    {
+        // Compression still in progress
+        if (entry.endsWith(QLatin1String(".tmp")))
+        {
+            continue;
+        }
+        QString segment = entry;
+        if (segment.endsWith(QLatin1String(".qz")))
+        {
+            segment.chop(3);
+        }
+        if (!segments.contains(segment))
+        {
+            segments.append(segment);
+        }
+    }
+
+    while (segments.size() > qMax(options.retainedSegments, 0))
+    {
+        QString oldest = segments.takeFirst();
+        logDir.remove(oldest);
+        logDir.remove(oldest + QLatin1String(".qz"));
+    }
+}
+
+void LogSink::compressSegment(const QString &segmentName)
+{
+    QFile segmentFile(segmentName);
+    if (!segmentFile.open(QIODevice::ReadOnly))
+    {
+        return;
+    }
+    QByteArray compressed = qCompress(segmentFile.readAll());
+    segmentFile.close();
+
+    // Write under a temporary name so a half written file never looks like a segment
+    QString temporaryName = segmentName + QLatin1String(".qz.tmp");
+    QFile compressedFile(temporaryName);
+    if (!compressedFile.open(QIODevice::WriteOnly | QIODevice::Truncate) ||
+        compressedFile.write(compressed) != compressed.size())
+    {
+        qDebug() << "Failed to compress log segment:" << segmentName;
+        compressedFile.remove();
+        return;
+    }
+    compressedFile.close();
+
+    if (QFile::rename(temporaryName, segmentName + QLatin1String(".qz")))
+    {
+        QFile::remove(segmentName);
+    }
+}
+
+void LogSink::formatText(const LogRecord *record, QByteArray &batch)
+{
+    batch.append('[');
+    batch.append(record->level.data(), record->level.size());
+    batch.append("] ", 2);
+    appendUtf8(batch, record->tag, false);
+    batch.append(": ", 2);
+    appendUtf8(batch, record->message, false);
+}
+
+void LogSink::formatJson(const LogRecord *record, QByteArray &batch)
+{
+    batch.append("{\"timestampNs\":", 15);
+    appendNumber(batch, record->timestampNs);
+    batch.append(",\"level\":\"", 10);
+    batch.append(record->level.data(), record->level.size());
+    batch.append("\",\"thread\":\"", 12);
+    if (record->threadName.isEmpty())
+    {
+        appendNumber(batch, qint64(record->threadId));
+    }
+    else
+    {
+        appendUtf8(batch, record->threadName, true);
+    }
+    batch.append("\",\"tag\":\"", 9);
+    appendUtf8(batch, record->tag, true);
+    batch.append('"');
+
+    // Request fields only appear for records logged while a request is handled
+    const LogContext &context = record->context;
+    if (context.socketDescriptor != -1)
+    {
+        batch.append(",\"socketDescriptor\":", 20);
+        appendNumber(batch, qint64(context.socketDescriptor));
+    }
+    if (context.startNs >= 0)
+    {
+        batch.append(",\"requestId\":", 13);
+        appendNumber(batch, context.requestId);
+        batch.append(",\"correlationId\":", 17);
+        appendNumber(batch, context.correlationId);
+        batch.append(",\"latencyUs\":", 13);
+        appendNumber(batch, (record->timestampNs - context.startNs) / 1000);
+    }
+
+    batch.append(",\"message\":\"", 12);
+    appendUtf8(batch, record->message, true);
+    batch.append("\"}", 2);
+}
+
+bool LogSink::formatFromName(const QString &name, Format *format)
+{
+    QString formatName = name.trimmed().toLower();
+
+    if (formatName == QLatin1String("text"))
+    {
+        *format = Text;
+        return true;
+    }
+    else if (formatName == QLatin1String("json"))
+    {
+        *format = JsonLines;
+        return true;
+    }
+
+    return false;
+}
+
+qint64 LogSink::monotonicNs()
+{
+    static QElapsedTimer clock = []()
+    {
+        QElapsedTimer timer;
+        timer.start();
+        return timer;
+    }();
+    return clock.nsecsElapsed();
+}
+
+LogContext &LogSink::currentContext()
+{
+    static thread_local LogContext context;
+    return context;
+}
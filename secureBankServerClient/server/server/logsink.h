@@ -0,0 +1,141 @@
+#ifndef LOGSINK_H
+#define LOGSINK_H
+
+#include <QString>
+#include <QLatin1String>
+#include <QByteArray>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QDateTime>
+#include <QThreadPool>
+#include <QThread>
+#include <QSemaphore>
+#include <QElapsedTimer>
+#include <QDebug>
+#include <atomic>
+
+// Request being handled on the current thread, stamped on every record logged meanwhile
+struct LogContext
+{
+    qintptr socketDescriptor = -1;
+    int requestId = -1;
+    qint64 correlationId = -1;
+    // Monotonic start of the request, -1 outside of a request
+    qint64 startNs = -1;
+};
+
+// Installs a LogContext for the lifetime of the scope and restores the previous one
+class LogContextScope
+{
+public:
+    LogContextScope(qintptr socketDescriptor, int requestId, qint64 correlationId);
+    ~LogContextScope();
+
+    // Microseconds since the scope was entered
+    qint64 elapsedUs() const;
+
+private:
+    LogContext previousContext;
+};
+
+// Process wide destination of every Logger.
+// Request threads only push records onto a lock free multi producer queue, a single
+// writer thread formats them into one preallocated batch and flushes by size or time.
+class LogSink
+{
+public:
+    enum Format
+    {
+        // [LEVEL] Tag: message
+        Text,
+        // One JSON object per line with timestamp, thread and request context
+        JsonLines
+    };
+
+    struct Options
+    {
+        QString fileName = "common_log.txt";
+        Format format = Text;
+        // Flush at least this often while lines are pending
+        int flushIntervalMs = 200;
+        // Flush early once this many bytes are batched
+        int flushBytes = 64 * 1024;
+        // Also echo every line to the console as the old logger did
+        bool echoToConsole = true;
+        // Start a new segment once the file reaches this size, 0 disables size rotation
+        qint64 maxFileBytes = 64 * 1024 * 1024;
+        // Start a new segment after this many hours, 0 disables time rotation
+        int rotateIntervalHours = 24;
+        // Rotated segments kept next to the live file, older ones are deleted
+        int retainedSegments = 10;
+        // qCompress rotated segments on the global thread pool
+        bool compressRotated = false;
+    };
+
+    static LogSink *instance();
+
+    // Records appended before start are kept and written once the writer runs
+    void start(const Options &options);
+    // Drains every pending record, closes the file and joins the writer
+    void stop();
+
+    // Only takes references to the strings, all formatting happens on the writer thread
+    void append(QLatin1String level, const QString &tag, const QString &message);
+
+    static bool formatFromName(const QString &name, Format *format);
+
+    // Monotonic nanoseconds since the sink was created
+    static qint64 monotonicNs();
+    static LogContext &currentContext();
+
+private:
+    LogSink();
+    ~LogSink();
+
+    struct LogRecord
+    {
+        std::atomic<LogRecord*> next{nullptr};
+        qint64 timestampNs = 0;
+        quintptr threadId = 0;
+        QString threadName;
+        QLatin1String level;
+        QString tag;
+        QString message;
+        LogContext context;
+    };
+
+    // Vyukov intrusive MPSC queue, producers only do one atomic exchange
+    void push(LogRecord *record);
+    LogRecord *pop();
+
+    void writerLoop();
+    void drainQueue(QByteArray &batch);
+    void writeBatch(QByteArray &batch);
+
+    bool openLogFile();
+    // Rotation runs on the writer thread, producers keep queueing meanwhile
+    void rotateIfNeeded();
+    void rotate();
+    void pruneSegments();
+    static void compressSegment(const QString &segmentName);
+
+    void formatText(const LogRecord *record, QByteArray &batch);
+    void formatJson(const LogRecord *record, QByteArray &batch);
+
+    std::atomic<LogRecord*> head;
+    LogRecord *tail;
+    LogRecord stub;
+    std::atomic<int> pendingCount{0};
+
+    std::atomic<bool> running{false};
+    std::atomic<bool> stopped{false};
+    QSemaphore wakeUp;
+    QThread *writerThread = nullptr;
+    Options options;
+    QFile logFile;
+    qint64 segmentBytes = 0;
+    QElapsedTimer segmentAge;
+};
+
+#endif // LOGSINK_H
@@ -1,9 +1,17 @@
 #include <QCoreApplication>
 #include <signal.h>
-#include <QTimer>
+#include <QThread>
+#include <QSettings>
 
 #include "databasemanager.h"
+#include "DatabaseConnectionPool.h"
 #include "backupmanager.h"
+#include "TransactionJournal.h"
+#include "BalanceCache.h"
+#include "LoginCache.h"
+#include "PasswordHasher.h"
+#include "JournalReplay.h"
+#include "MessageCodec.h"
 #include "Server.h"
 #include "Logger.h"
 
@@ -20,34 +28,199 @@ int main(int argc, char *argv[])
     //it's annoying in windows to implement this...
     //signal(SIGHUP, handleSignal);
 
-    initializeDatabase();
+    // Optional settings next to the executable, missing keys fall back to the defaults
+    QSettings settings("server.ini", QSettings::IniFormat);
+
+    // Start the background log writer, it is drained when the application object goes away
+    LogSink::Options logOptions;
+    logOptions.fileName = settings.value("Logging/file", logOptions.fileName).toString();
+    LogSink::formatFromName(settings.value("Logging/format", "text").toString(), &logOptions.format);
+    logOptions.flushIntervalMs = settings.value("Logging/flushIntervalMs",
+                                                logOptions.flushIntervalMs).toInt();
+    logOptions.flushBytes = settings.value("Logging/flushBytes", logOptions.flushBytes).toInt();
+    logOptions.echoToConsole = settings.value("Logging/console", logOptions.echoToConsole).toBool();
+    logOptions.maxFileBytes = settings.value("Logging/maxFileBytes", logOptions.maxFileBytes).toLongLong();
+    logOptions.rotateIntervalHours = settings.value("Logging/rotateIntervalHours",
+                                                    logOptions.rotateIntervalHours).toInt();
+    logOptions.retainedSegments = settings.value("Logging/retainedSegments",
+                                                 logOptions.retainedSegments).toInt();
+    logOptions.compressRotated = settings.value("Logging/compressRotated",
+                                                logOptions.compressRotated).toBool();
+    LogSink::instance()->start(logOptions);
+    Logger::setMinimumLevel(Logger::levelFromName(settings.value("Logging/level").toString(),
+                                                  Logger::Info));
+    qAddPostRoutine([]() { LogSink::instance()->stop(); });
+
+    // SQLite pragmas applied to every connection, an empty value skips the pragma
+    PragmaProfile pragmaProfile = DatabaseManager::defaultPragmaProfile();
+    for (QPair<QString, QString> &pragma : pragmaProfile)
+    {
+        pragma.second = settings.value("Database/" + pragma.first, pragma.second).toString();
+    }
+    DatabaseManager::setPragmaProfile(pragmaProfile);
+
+    // Warm connections kept open by each worker thread
+    DatabaseConnectionPool::setMaxConnectionsPerThread(
+        settings.value("Database/maxConnectionsPerWorker", 2).toInt());
+
+    // Balances of the most used accounts are served from memory, 0 disables the cache
+    BalanceCache::instance()->setCapacityPerShard(
+        settings.value("BalanceCache/accountsPerShard", 4096).toInt());
+
+    // Recently authenticated users log in again without a database lookup, 0 disables the cache
+    LoginCache::instance()->setOptions(settings.value("LoginCache/maxPrincipals", 1024).toInt(),
+                                       settings.value("LoginCache/maxAgeSeconds", 300).toInt());
+
+    // Cost of new password hashes and the pool that computes and verifies them
+    PasswordHasher::Options passwordOptions;
+    passwordOptions.iterations = settings.value("Password/iterations", passwordOptions.iterations).toInt();
+    passwordOptions.threads = settings.value("Password/hashingThreads", passwordOptions.threads).toInt();
+    passwordOptions.maxPending = settings.value("Password/maxPendingHashes",
+                                                passwordOptions.maxPending).toInt();
+    PasswordHasher::setOptions(passwordOptions);
+
+    TransactionJournal::Options journalOptions;
+    journalOptions.directory = settings.value("Journal/directory", journalOptions.directory).toString();
+    journalOptions.waitForSync = settings.value("Journal/waitForSync", journalOptions.waitForSync).toBool();
+
+    // server --replay-journal [target.db] rebuilds the database from the latest backup and the journal
+    QStringList arguments = bankServer.arguments();
+    int replayIndex = arguments.indexOf("--replay-journal");
+    if (replayIndex != -1)
+    {
+        // The target can always be rebuilt again, don't wait for the disk on every commit
+        for (QPair<QString, QString> &pragma : pragmaProfile)
+        {
+            if (pragma.first == "synchronous")
+            {
+                pragma.second = "OFF";
+            }
+        }
+        DatabaseManager::setPragmaProfile(pragmaProfile);
+
+        JournalReplay journalReplay(journalOptions.directory);
+        return journalReplay.run(arguments.value(replayIndex + 1, "bankdatabase_replayed.db"));
+    }
 
-    DatabaseManager databaseManager("DatabaseBackupConnection");
-    BackupManager backupManager(&databaseManager);
+    // server --benchmark-kdf [iterations,...] measures logins per second at each hashing cost
+    int benchmarkIndex = arguments.indexOf("--benchmark-kdf");
+    if (benchmarkIndex != -1)
+    {
+        QList<int> iterationCounts = {10000, 50000, 120000, 310000, 600000};
+        QString requestedCounts = arguments.value(benchmarkIndex + 1);
+        if (!requestedCounts.isEmpty() && !requestedCounts.startsWith("--"))
+        {
+            iterationCounts.clear();
+            for (const QString &count : requestedCounts.split(',', Qt::SkipEmptyParts))
+            {
+                iterationCounts.append(qMax(1, count.toInt()));
+            }
+        }
+        return PasswordHasher::runBenchmark(iterationCounts, 2000);
+    }
 
-    // Create a QTimer object
-    QTimer *timer = new QTimer(&bankServer);
-    // Connect the timeout signal to the createFullBackup slot
-    QObject::connect(timer, &QTimer::timeout, &backupManager,
-                     &BackupManager::createFullBackup);
-    // Start the timer to trigger every 6 hours for periodic backups
-    timer->start(6 * 60 * 60 * 1000);
+    // server --restore-backup target.db [manifest] reassembles a backup, the newest by default
+    int restoreIndex = arguments.indexOf("--restore-backup");
+    if (restoreIndex != -1)
+    {
+        BackupChunkStore chunkStore;
+        QString manifestFileName = arguments.value(restoreIndex + 2, chunkStore.latestManifest());
+        QString targetFileName = arguments.value(restoreIndex + 1, "bankdatabase_restored.db");
+        return chunkStore.restoreSnapshot(manifestFileName, targetFileName) ? 0 : 1;
+    }
 
-    // Connect the aboutToQuit signal to the handleShutdown slot
-    QObject::connect(&bankServer, &QCoreApplication::aboutToQuit, &backupManager,
-                     &BackupManager::handleShutdown);
+    initializeDatabase();
 
-    Server server(&bankServer);
+    // Every committed change is journaled so the state between backups can be rebuilt
+    if (settings.value("Journal/enabled", true).toBool())
+    {
+        TransactionJournal::instance()->start(journalOptions);
+        qAddPostRoutine([]() { TransactionJournal::instance()->stop(); });
+    }
+
+    // Online backups copy this many pages per step and pause between steps
+    BackupEngine::Options backupOptions;
+    backupOptions.pagesPerStep = settings.value("Backup/pagesPerStep",
+                                                backupOptions.pagesPerStep).toInt();
+    backupOptions.stepDelayMs = settings.value("Backup/stepDelayMs",
+                                               backupOptions.stepDelayMs).toInt();
+    backupOptions.maxBusyRetries = settings.value("Backup/maxBusyRetries",
+                                                  backupOptions.maxBusyRetries).toInt();
+    BackupEngine::setOptions(backupOptions);
+
+    // Backups, pruning and the shutdown backup run on their own low priority thread,
+    // the thread accepting connections never waits for the disk
+    QThread backupThread;
+    backupThread.setObjectName("BackupIO");
+    BackupManager *backupManager = new BackupManager(settings.value("Backup/pruneDelayMs", 20).toInt(),
+                                                     settings.value("Backup/chunkSize", 64 * 1024).toInt());
+    backupManager->moveToThread(&backupThread);
+    QObject::connect(&backupThread, &QThread::started, backupManager,
+                     &BackupManager::startSchedule);
+    QObject::connect(&backupThread, &QThread::finished, backupManager, &QObject::deleteLater);
+
+    // The shutdown backup is written before the backup thread is stopped
+    QObject::connect(&bankServer, &QCoreApplication::aboutToQuit, &bankServer,
+                     [&backupThread, backupManager]()
+    {
+        QMetaObject::invokeMethod(backupManager, &BackupManager::handleShutdown,
+                                  Qt::BlockingQueuedConnection);
+        backupThread.quit();
+        backupThread.wait();
+    });
+    backupThread.start(QThread::LowPriority);
+
+    // 0 means one worker thread per CPU core
+    int workerThreads = settings.value("Server/workerThreads", 0).toInt();
+
+    // Response compression, small replies are sent uncompressed
+    MessageCodec::CompressionPolicy compressionPolicy = MessageCodec::defaultCompressionPolicy();
+    compressionPolicy.threshold = settings.value("Compression/threshold",
+                                                 compressionPolicy.threshold).toInt();
+    compressionPolicy.defaultLevel = settings.value("Compression/defaultLevel",
+                                                    compressionPolicy.defaultLevel).toInt();
+    compressionPolicy.levels[5] = settings.value("Compression/viewDatabaseLevel",
+                                                 compressionPolicy.levels.value(5)).toInt();
+    compressionPolicy.levels[8] = settings.value("Compression/viewTransactionHistoryLevel",
+                                                 compressionPolicy.levels.value(8)).toInt();
+    MessageCodec::setCompressionPolicy(compressionPolicy);
+
+    // Idle connections stay open on heartbeats, their request handler is released meanwhile
+    ClientRunnable::Options connectionOptions;
+    connectionOptions.idleStateMs = settings.value("Connection/idleStateMs",
+                                                   connectionOptions.idleStateMs).toInt();
+    connectionOptions.maxSilenceMs = settings.value("Connection/maxSilenceMs",
+                                                    connectionOptions.maxSilenceMs).toInt();
+    connectionOptions.maxIdleMs = settings.value("Connection/maxIdleMs",
+                                                 connectionOptions.maxIdleMs).toInt();
+    connectionOptions.heartbeatIntervalMs = settings.value("Connection/heartbeatIntervalMs",
+                                                           connectionOptions.heartbeatIntervalMs).toInt();
+    ClientRunnable::setOptions(connectionOptions);
 
     Logger mainLogger("Main");
 
+    // Parsed once, every connection reuses the same certificate, key and protocol settings.
+    // Without them no handshake can succeed, so the server does not start
+    if (!ClientRunnable::loadSslConfiguration(settings.value("Server/certificate", "server.crt").toString(),
+                                              settings.value("Server/privateKey", "server.key").toString()))
+    {
+        LOG_ERROR(mainLogger, "Failed to load the TLS certificate or key, the server is not started.");
+        backupThread.quit();
+        backupThread.wait();
+        return 1;
+    }
+
+    Server server(&bankServer, workerThreads);
+
     if (!server.isListening())
     {
-        mainLogger.log("Failed to start the server.");
+        LOG_ERROR(mainLogger, "Failed to start the server.");
+        backupThread.quit();
+        backupThread.wait();
         return 1;
     }
 
-    mainLogger.log("Event loop Started.");
+    LOG_DEBUG(mainLogger, "Event loop Started.");
 
     bankServer.processEvents();
     return bankServer.exec();
@@ -64,6 +237,6 @@ void handleSignal(int signal)
     Q_UNUSED(signal);
     Logger signalLogger("ExitSignal");
 
-    signalLogger.log("Received exit signal. Initiating server shutdown.");
+    LOG_INFO(signalLogger, "Received exit signal. Initiating server shutdown.");
     QCoreApplication::quit();
 }
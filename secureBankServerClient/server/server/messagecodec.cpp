@@ -0,0 +1,332 @@
+#include "MessageCodec.h"
+
+// JSON only allows these four characters as insignificant whitespace
+static bool isJsonWhitespace(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+// Writes value straight into the CBOR stream, without building a QCborValue first.
+// Integral numbers are written as CBOR integers, like QCborValue::fromJsonValue does.
+static void writeCborValue(QCborStreamWriter &writer, const QJsonValue &value)
+{
+    switch (value.type())
+    {
+    case QJsonValue::Bool:
+        writer.append(value.toBool());
+        break;
+    case QJsonValue::Double:
+    {
+        double number = value.toDouble();
+        qint64 integer = value.toInteger();
+        if (static_cast<double>(integer) == number)
+        {
+            writer.append(integer);
+        }
+        else
+        {
+            writer.append(number);
+        }
+        break;
+    }
+    case QJsonValue::String:
+        writer.append(value.toString());
+        break;
+    case QJsonValue::Array:
+    {
+        const QJsonArray array = value.toArray();
+        writer.startArray(static_cast<quint64>(array.size()));
+        for (const QJsonValue &element : array)
+        {
+            writeCborValue(writer, element);
+        }
+        writer.endArray();
+        break;
+    }
+    case QJsonValue::Object:
+    {
+        const QJsonObject object = value.toObject();
+        writer.startMap(static_cast<quint64>(object.size()));
+        for (QJsonObject::const_iterator it = object.constBegin(); it != object.constEnd(); ++it)
+        {
+            writer.append(it.key());
+            writeCborValue(writer, it.value());
+        }
+        writer.endMap();
+        break;
+    }
+    default:
+        writer.append(nullptr);
+        break;
+    }
+}
+
+static QByteArray encodeCbor(const QJsonObject &object)
+{
+    QByteArray data;
+    QCborStreamWriter writer(&data);
+    writeCborValue(writer, object);
+    return data;
+}
+
+// Text strings may arrive in chunks
+static bool readCborString(QCborStreamReader &reader, QString *string)
+{
+    string->clear();
+    QCborStreamReader::StringResult<QString> chunk = reader.readString();
+    while (chunk.status == QCborStreamReader::Ok)
+    {
+        string->append(chunk.data);
+        chunk = reader.readString();
+    }
+    return chunk.status == QCborStreamReader::EndOfString;
+}
+
+// Nesting allowed in a received message, the same bound Qt's own parsers use.
+// Messages come from the network, deeper data must not exhaust the stack.
+#define CBOR_MAX_DEPTH 1024
+
+// Reads the value at the reader's position straight into a QJsonValue
+static bool readCborValue(QCborStreamReader &reader, QJsonValue *value, int depth)
+{
+    if (depth > CBOR_MAX_DEPTH)
+    {
+        return false;
+    }
+
+    switch (reader.type())
+    {
+    case QCborStreamReader::UnsignedInteger:
+    case QCborStreamReader::NegativeInteger:
+        *value = reader.toInteger();
+        return reader.next();
+    case QCborStreamReader::Float16:
+        *value = static_cast<double>(reader.toFloat16());
+        return reader.next();
+    case QCborStreamReader::Float:
+        *value = static_cast<double>(reader.toFloat());
+        return reader.next();
+    case QCborStreamReader::Double:
+        *value = reader.toDouble();
+        return reader.next();
+    case QCborStreamReader::SimpleType:
+        if (reader.isFalse() || reader.isTrue())
+        {
+            *value = reader.toBool();
+        }
+        else
+        {
+            *value = QJsonValue(QJsonValue::Null);
+        }
+        return reader.next();
+    case QCborStreamReader::String:
+    {
+        QString string;
+        if (!readCborString(reader, &string))
+        {
+            return false;
+        }
+        *value = string;
+        return true;
+    }
+    case QCborStreamReader::Tag:
+        // Tags only annotate the value that follows
+        return reader.next() && readCborValue(reader, value, depth + 1);
+    case QCborStreamReader::Array:
+    {
+        QJsonArray array;
+        if (!reader.enterContainer())
+        {
+            return false;
+        }
+        while (reader.hasNext())
+        {
+            QJsonValue element;
+            if (!readCborValue(reader, &element, depth + 1))
+            {
+                return false;
+            }
+            array.append(element);
+        }
+        *value = array;
+        return reader.leaveContainer();
+    }
+    case QCborStreamReader::Map:
+    {
+        QJsonObject object;
+        if (!reader.enterContainer())
+        {
+            return false;
+        }
+        while (reader.hasNext())
+        {
+            // Only text keys are part of the protocol
+            QString key;
+            if (!reader.isString() || !readCborString(reader, &key))
+            {
+                return false;
+            }
+            QJsonValue element;
+            if (!readCborValue(reader, &element, depth + 1))
+            {
+                return false;
+            }
+            object.insert(key, element);
+        }
+        *value = object;
+        return reader.leaveContainer();
+    }
+    default:
+        // Byte strings, undefined and invalid data never appear in a message
+        return false;
+    }
+}
+
+static bool decodeCbor(const QByteArray &data, QJsonObject *object)
+{
+    QCborStreamReader reader(data);
+    QJsonValue value;
+    if (!reader.isMap() || !readCborValue(reader, &value, 0) ||
+        reader.lastError() != QCborError::NoError)
+    {
+        return false;
+    }
+    // A frame carries exactly one message
+    if (reader.currentOffset() != data.size())
+    {
+        return false;
+    }
+    *object = value.toObject();
+    return true;
+}
+
+MessageCodec::CompressionPolicy MessageCodec::compressionPolicy =
+    MessageCodec::defaultCompressionPolicy();
+
+MessageCodec::MessageCodec()
+{}
+
+MessageCodec::Encoding MessageCodec::encoding() const
+{
+    return currentEncoding;
+}
+
+void MessageCodec::setEncoding(Encoding encoding)
+{
+    currentEncoding = encoding;
+}
+
+bool MessageCodec::compressionEnabled() const
+{
+    return compression;
+}
+
+void MessageCodec::setCompressionEnabled(bool enabled)
+{
+    compression = enabled;
+}
+
+MessageCodec::CompressionPolicy MessageCodec::defaultCompressionPolicy()
+{
+    CompressionPolicy policy;
+    // viewDatabase and viewTransactionHistory replies are large and repetitive
+    policy.levels.insert(5, 6);
+    policy.levels.insert(8, 6);
+    return policy;
+}
+
+void MessageCodec::setCompressionPolicy(const CompressionPolicy &policy)
+{
+    compressionPolicy = policy;
+}
+
+QJsonObject MessageCodec::decodeRequest(const QByteArray &message, bool *ok) const
+{
+    *ok = false;
+
+    // Skip leading whitespace so indented JSON is detected too
+    qsizetype start = 0;
+    while (start < message.size() && isJsonWhitespace(message.at(start)))
+    {
+        ++start;
+    }
+    if (start == message.size())
+    {
+        return QJsonObject();
+    }
+
+    if (message.at(start) == '{')
+    {
+        QJsonParseError parseError;
+        QJsonDocument jsonDoc = QJsonDocument::fromJson(message, &parseError);
+        if (parseError.error != QJsonParseError::NoError || !jsonDoc.isObject())
+        {
+            return QJsonObject();
+        }
+        *ok = true;
+        return jsonDoc.object();
+    }
+
+    QJsonObject requestJson;
+    if (!decodeCbor(message, &requestJson))
+    {
+        return QJsonObject();
+    }
+    *ok = true;
+    return requestJson;
+}
+
+QByteArray MessageCodec::encodeResponse(const QJsonObject &responseJson) const
+{
+    QByteArray responseData;
+    if (currentEncoding == Cbor)
+    {
+        responseData = encodeCbor(responseJson);
+    }
+    else
+    {
+        // Convert the JSON object to a byte array using compact removing white spaces
+        responseData = QJsonDocument(responseJson).toJson(QJsonDocument::Compact);
+    }
+
+    quint8 flags = 0;
+    if (compression && responseData.size() >= compressionPolicy.threshold)
+    {
+        int requestId = responseJson["responseId"].toInt();
+        int level = compressionPolicy.levels.value(requestId, compressionPolicy.defaultLevel);
+
+        // Keep the compressed data only when it actually saves space
+        QByteArray compressedData = qCompress(responseData, level);
+        if (compressedData.size() < responseData.size())
+        {
+            responseData = compressedData;
+            flags |= Compressed;
+        }
+    }
+
+    QByteArray message;
+    message.reserve(1 + responseData.size());
+    message.append(static_cast<char>(flags));
+    message.append(responseData);
+    return message;
+}
+
+bool MessageCodec::encodingFromName(const QString &name, Encoding *encoding)
+{
+    if (name.compare("json", Qt::CaseInsensitive) == 0)
+    {
+        *encoding = Json;
+        return true;
+    }
+    if (name.compare("cbor", Qt::CaseInsensitive) == 0)
+    {
+        *encoding = Cbor;
+        return true;
+    }
+    return false;
+}
+
+QString MessageCodec::encodingName(Encoding encoding)
+{
+    return encoding == Cbor ? "cbor" : "json";
+}
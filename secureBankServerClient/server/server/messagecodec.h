@@ -0,0 +1,70 @@
+#ifndef MESSAGECODEC_H
+#define MESSAGECODEC_H
+
+#include <QByteArray>
+#include <QString>
+#include <QJsonObject>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QCborStreamReader>
+#include <QCborStreamWriter>
+#include <QHash>
+
+// Request ID used by a client to pick the encoding of its connection
+#define NEGOTIATE_PROTOCOL_REQUEST 10
+// Keeps an otherwise quiet connection open, answered without touching the database
+#define HEARTBEAT_REQUEST 11
+
+// Encodes and decodes protocol messages for one connection.
+// Requests are accepted in any encoding, JSON text always starts with '{' while a
+// CBOR map never does, so old JSON clients keep working after a client negotiated CBOR.
+// Every response starts with a flag byte telling the client whether the rest is compressed.
+class MessageCodec
+{
+public:
+    enum Encoding
+    {
+        Json,
+        Cbor
+    };
+
+    enum ResponseFlag
+    {
+        Compressed = 0x01
+    };
+
+    struct CompressionPolicy
+    {
+        // Payloads smaller than this are sent as they are
+        int threshold = 256;
+        // zlib level used when a response type has no level of its own
+        int defaultLevel = 1;
+        // zlib level per requestId
+        QHash<int, int> levels;
+    };
+
+    MessageCodec();
+
+    Encoding encoding() const;
+    void setEncoding(Encoding encoding);
+    bool compressionEnabled() const;
+    void setCompressionEnabled(bool enabled);
+
+    // Shared by every connection, set once at startup before clients are accepted
+    static CompressionPolicy defaultCompressionPolicy();
+    static void setCompressionPolicy(const CompressionPolicy &policy);
+
+    QJsonObject decodeRequest(const QByteArray &message, bool *ok) const;
+    QByteArray encodeResponse(const QJsonObject &responseJson) const;
+
+    static bool encodingFromName(const QString &name, Encoding *encoding);
+    static QString encodingName(Encoding encoding);
+
+private:
+    Encoding currentEncoding = Json;
+    bool compression = true;
+
+    static CompressionPolicy compressionPolicy;
+};
+
+#endif // MESSAGECODEC_H
@@ -0,0 +1,42 @@
+#ifndef MESSAGEFRAMER_H
+#define MESSAGEFRAMER_H
+
+#include <QObject>
+#include <QIODevice>
+#include <QByteArray>
+#include <QtEndian>
+
+// Every message on the wire is a 4 byte big endian payload length followed by the payload
+#define FRAME_HEADER_SIZE 4
+// Largest payload accepted from the peer, anything bigger is treated as a broken stream
+#define MAX_FRAME_SIZE (64 * 1024 * 1024)
+
+class MessageFramer : public QObject
+{
+    Q_OBJECT
+
+public:
+    MessageFramer(QIODevice *device, QObject *parent = nullptr);
+    ~MessageFramer();
+
+    bool sendMessage(const QByteArray &message);
+    // Drop any partially received frame, used when the device is reconnected
+    void reset();
+    // Give the reassembly buffer's memory back, used while the connection is idle
+    void releaseBuffer();
+
+signals:
+    void messageReceived(const QByteArray &message);
+    void framingError(const QString &errorMessage);
+
+private slots:
+    void readyRead();
+
+private:
+    QIODevice *device = nullptr;
+    // Reassembly buffer, bytes before readOffset were already handed out
+    QByteArray buffer;
+    qsizetype readOffset = 0;
+};
+
+#endif // MESSAGEFRAMER_H
@@ -0,0 +1,140 @@
+#include "Money.h"
+
+// Largest amount accepted from a client, far below the point where doubles lose cents
+#define MAX_MAJOR_UNITS 1000000000000.0
+
+Money::Money()
+    : minorUnits(0)
+{}
+
+Money::Money(qint64 minorUnits)
+    : minorUnits(minorUnits)
+{}
+
+Money Money::fromMinorUnits(qint64 minorUnits)
+{
+    return Money(minorUnits);
+}
+
+Money Money::fromJson(const QJsonValue &value, bool *ok)
+{
+    if (ok != nullptr)
+    {
+        *ok = false;
+    }
+
+    if (value.isDouble())
+    {
+        double majorUnits = value.toDouble();
+        if (!std::isfinite(majorUnits) || std::fabs(majorUnits) > MAX_MAJOR_UNITS)
+        {
+            return Money();
+        }
+        double scaled = majorUnits * MINOR_UNITS_PER_MAJOR;
+        qint64 rounded = qRound64(scaled);
+        // 12.345 is not a valid amount, 12.34 only misses 1234 by a representation error
+        if (std::fabs(scaled - rounded) > 1e-6)
+        {
+            return Money();
+        }
+        if (ok != nullptr)
+        {
+            *ok = true;
+        }
+        return Money(rounded);
+    }
+
+    if (value.isString())
+    {
+        static const QRegularExpression decimalPattern("^\\s*(-?)(\\d{1,12})(?:\\.(\\d{1,2}))?\\s*$");
+        QRegularExpressionMatch match = decimalPattern.match(value.toString());
+        if (!match.hasMatch())
+        {
+            return Money();
+        }
+        qint64 majorUnits = match.captured(2).toLongLong();
+        QString fraction = match.captured(3).leftJustified(2, '0');
+        qint64 amount = majorUnits * MINOR_UNITS_PER_MAJOR + fraction.toLongLong();
+        if (ok != nullptr)
+        {
+            *ok = true;
+        }
+        return Money(match.captured(1).isEmpty() ? amount : -amount);
+    }
+
+    return Money();
+}
+
+Money Money::fromVariant(const QVariant &value)
+{
+    return Money(value.toLongLong());
+}
+
+qint64 Money::toMinorUnits() const
+{
+    return minorUnits;
+}
+
+QJsonValue Money::toJson() const
+{
+    return QJsonValue(double(minorUnits) / MINOR_UNITS_PER_MAJOR);
+}
+
+QString Money::toString() const
+{
+    qint64 magnitude = minorUnits < 0 ? -minorUnits : minorUnits;
+    return QString("%1%2.%3").
+           arg(minorUnits < 0 ? "-" : "").
+           arg(magnitude / MINOR_UNITS_PER_MAJOR).
+           arg(magnitude % MINOR_UNITS_PER_MAJOR, 2, 10, QChar('0'));
+}
+
+bool Money::isNegative() const
+{
+    return minorUnits < 0;
+}
+
+Money Money::operator+(const Money &other) const
+{
+    return Money(minorUnits + other.minorUnits);
+}
+
+Money Money::operator-(const Money &other) const
+{
+    return Money(minorUnits - other.minorUnits);
+}
+
+Money Money::operator-() const
+{
+    return Money(-minorUnits);
+}
+
+bool Money::operator==(const Money &other) const
+{
+    return minorUnits == other.minorUnits;
+}
+
+bool Money::operator!=(const Money &other) const
+{
+    return minorUnits != other.minorUnits;
+}
+
+bool Money::operator<(const Money &other) const
+{
+    return minorUnits < other.minorUnits;
+}
+
+bool Money::operator<=(const Money &other) const
+{
+    return minorUnits <= other.minorUnits;
+}
+
+bool Money::operator>(const Money &other) const
+{
+    return minorUnits > other.minorUnits;
+}
+
+bool Money::operator>=(const Money &other) const
+{
+    return minorUnits >= other.minorUnits;
+}
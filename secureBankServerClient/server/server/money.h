@@ -0,0 +1,50 @@
+#ifndef MONEY_H
+#define MONEY_H
+
+#include <QString>
+#include <QJsonValue>
+#include <QVariant>
+#include <QRegularExpression>
+#include <QtGlobal>
+#include <cmath>
+
+// Amount of money as a 64 bit count of minor units (cents). Requests are converted once
+// at the JSON boundary, everything below, storage included, is exact integer arithmetic.
+class Money
+{
+public:
+    static const qint64 MINOR_UNITS_PER_MAJOR = 100;
+
+    Money();
+
+    static Money fromMinorUnits(qint64 minorUnits);
+    // Numbers and decimal strings in major units, "12.34" and 12.34 are both 1234 minor units.
+    // ok is false for anything else, for more than two decimals and for out of range values.
+    static Money fromJson(const QJsonValue &value, bool *ok = nullptr);
+    // INTEGER column value
+    static Money fromVariant(const QVariant &value);
+
+    qint64 toMinorUnits() const;
+    // Major units, as the clients expect
+    QJsonValue toJson() const;
+    QString toString() const;
+
+    bool isNegative() const;
+
+    Money operator+(const Money &other) const;
+    Money operator-(const Money &other) const;
+    Money operator-() const;
+    bool operator==(const Money &other) const;
+    bool operator!=(const Money &other) const;
+    bool operator<(const Money &other) const;
+    bool operator<=(const Money &other) const;
+    bool operator>(const Money &other) const;
+    bool operator>=(const Money &other) const;
+
+private:
+    explicit Money(qint64 minorUnits);
+
+    qint64 minorUnits;
+};
+
+#endif // MONEY_H
@@ -0,0 +1,173 @@
+#include "PasswordHasher.h"
+
+#define CREDENTIAL_SCHEME "pbkdf2-sha256"
+#define SALT_BYTES 16
+#define HASH_BYTES 32
+
+PasswordHasher::Options PasswordHasher::options;
+QAtomicInt PasswordHasher::pending;
+
+void PasswordHasher::setOptions(const Options &options)
+{
+    PasswordHasher::options = options;
+    PasswordHasher::options.iterations = qMax(1, options.iterations);
+    pool()->setMaxThreadCount(options.threads > 0 ? options.threads
+                                                  : qMax(1, QThread::idealThreadCount() / 2));
+}
+
+int PasswordHasher::iterations()
+{
+    return options.iterations;
+}
+
+QThreadPool *PasswordHasher::pool()
+{
+    static QThreadPool *hashingPool = []()
+    {
+        QThreadPool *threadPool = new QThreadPool();
+        threadPool->setObjectName("PasswordHashing");
+        threadPool->setMaxThreadCount(qMax(1, QThread::idealThreadCount() / 2));
+        return threadPool;
+    }();
+    return hashingPool;
+}
+
+QString PasswordHasher::hashPassword(const QString &password)
+{
+    return hashPassword(password, options.iterations);
+}
+
+QString PasswordHasher::hashPassword(const QString &password, int iterations)
+{
+    QByteArray salt(SALT_BYTES, Qt::Uninitialized);
+    QRandomGenerator::system()->fillRange(reinterpret_cast<quint32 *>(salt.data()),
+                                          salt.size() / sizeof(quint32));
+
+    QByteArray hash = QPasswordDigestor::deriveKeyPbkdf2(QCryptographicHash::Sha256,
+                                                         password.toUtf8(), salt,
+                                                         iterations, HASH_BYTES);
+    return QString("%1$%2$%3$%4").
+           arg(CREDENTIAL_SCHEME).
+           arg(iterations).
+           arg(QString::fromLatin1(salt.toBase64()),
+               QString::fromLatin1(hash.toBase64()));
+}
+
+bool PasswordHasher::verifyPassword(const QString &password, const QString &credential,
+                                    bool *needsRehash)
+{
+    if (needsRehash != nullptr)
+    {
+        *needsRehash = false;
+    }
+    if (credential.isEmpty())
+    {
+        return false;
+    }
+
+    // Accounts created before hashing still hold the password itself
+    if (!credential.startsWith(CREDENTIAL_SCHEME "$"))
+    {
+        bool matches = constantTimeEquals(password.toUtf8(), credential.toUtf8());
+        if (needsRehash != nullptr)
+        {
+            *needsRehash = matches;
+        }
+        return matches;
+    }
+
+    QStringList fields = credential.split('$');
+    bool iterationsValid;
+    int credentialIterations = fields.value(1).toInt(&iterationsValid);
+    QByteArray salt = QByteArray::fromBase64(fields.value(2).toLatin1());
+    QByteArray expectedHash = QByteArray::fromBase64(fields.value(3).toLatin1());
+    if (fields.size() != 4 || !iterationsValid || credentialIterations <= 0 ||
+        salt.isEmpty() || expectedHash.isEmpty())
+    {
+        return false;
+    }
+
+    QByteArray hash = QPasswordDigestor::deriveKeyPbkdf2(QCryptographicHash::Sha256,
+                                                         password.toUtf8(), salt,
+                                                         credentialIterations, expectedHash.size());
+    bool matches = constantTimeEquals(hash, expectedHash);
+    if (needsRehash != nullptr)
+    {
+        *needsRehash = matches && credentialIterations < options.iterations;
+    }
+    return matches;
+}
+
+QString PasswordHasher::dummyCredential()
+{
+    static const QString credential = hashPassword(QString());
+    return credential;
+}
+
+bool PasswordHasher::constantTimeEquals(const QByteArray &first, const QByteArray &second)
+{
+    if (first.size() != second.size())
+    {
+        return false;
+    }
+    // Same time whichever byte differs
+    char difference = 0;
+    for (int i = 0; i < first.size(); ++i)
+    {
+        difference |= first.at(i) ^ second.at(i);
+    }
+    return difference == 0;
+}
+
+bool PasswordHasher::schedule(const std::function<void()> &task)
+{
+    if (pending.fetchAndAddRelaxed(1) >= options.maxPending)
+    {
+        pending.fetchAndSubRelaxed(1);
+        return false;
+    }
+
+    pool()->start([task]()
+    {
+        task();
+        pending.fetchAndSubRelaxed(1);
+    });
+    return true;
+}
+
+int PasswordHasher::runBenchmark(const QList<int> &iterationCounts, int durationMs)
+{
+    Logger logger("PasswordHasher");
+    int threads = pool()->maxThreadCount();
+
+    for (int iterationCount : iterationCounts)
+    {
+        QString credential = hashPassword("benchmark", iterationCount);
+        QAtomicInt verifications;
+        QElapsedTimer timer;
+        timer.start();
+
+        // Every hashing thread verifies until the time is up, like a burst of logins
+        for (int i = 0; i < threads; ++i)
+        {
+            pool()->start([&verifications, &timer, credential, durationMs]()
+            {
+                while (timer.elapsed() < durationMs)
+                {
+                    verifyPassword("benchmark", credential);
+                    verifications.fetchAndAddRelaxed(1);
+                }
+            });
+        }
+        pool()->waitForDone();
+
+        qint64 elapsedMs = qMax<qint64>(1, timer.elapsed());
+        int count = verifications.loadRelaxed();
+        LOG_INFO(logger, QString("%1 iterations: %2 logins/s on %3 threads, %4 ms per login.").
+                   arg(iterationCount).
+                   arg(count * 1000.0 / elapsedMs, 0, 'f', 1).
+                   arg(threads).
+                   arg(count > 0 ? double(elapsedMs) * threads / count : 0.0, 0, 'f', 2));
+    }
+    return 0;
+}
@@ -0,0 +1,65 @@
+#ifndef PASSWORDHASHER_H
+#define PASSWORDHASHER_H
+
+#include <QString>
+#include <QByteArray>
+#include <QStringList>
+#include <QList>
+#include <QThreadPool>
+#include <QThread>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QPasswordDigestor>
+#include <QCryptographicHash>
+#include <QRandomGenerator>
+#include <functional>
+
+#include "Logger.h"
+
+// Salted PBKDF2-HMAC-SHA256 credentials, stored as "pbkdf2-sha256$<iterations>$<salt>$<hash>".
+// Every account has its own random salt and the iteration count is kept with the hash,
+// so the cost can be raised at any time and older hashes are upgraded on their next login.
+// Hashing is slow on purpose, it runs on a small dedicated pool instead of the connection threads.
+class PasswordHasher
+{
+public:
+    struct Options
+    {
+        // Iterations of new hashes
+        int iterations = 120000;
+        // Threads of the hashing pool, 0 = half of the CPU cores
+        int threads = 0;
+        // Hashes waiting for a thread before new requests are turned away
+        int maxPending = 256;
+    };
+
+    // Set once at startup, before the first hash
+    static void setOptions(const Options &options);
+    static int iterations();
+
+    static QString hashPassword(const QString &password);
+    static QString hashPassword(const QString &password, int iterations);
+    // needsRehash is set for plaintext credentials of older databases and for fewer iterations
+    // than configured. An empty credential is never matched.
+    static bool verifyPassword(const QString &password, const QString &credential,
+                               bool *needsRehash = nullptr);
+    // Verified in place of a missing account, a failed login takes the same time either way
+    static QString dummyCredential();
+
+    static bool constantTimeEquals(const QByteArray &first, const QByteArray &second);
+
+    // Runs task on the hashing pool, false when maxPending hashes are already waiting
+    static bool schedule(const std::function<void()> &task);
+
+    // Logs logins per second at every iteration count with all hashing threads busy.
+    // Returns the process exit code.
+    static int runBenchmark(const QList<int> &iterationCounts, int durationMs);
+
+private:
+    static Options options;
+    static QAtomicInt pending;
+
+    static QThreadPool *pool();
+};
+
+#endif // PASSWORDHASHER_H
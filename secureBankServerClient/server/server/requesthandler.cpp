@@ -1,19 +1,19 @@
 #include "RequestHandler.h"
 
-RequestHandler::RequestHandler(DatabaseManager* databaseManager, QObject *parent)
-    : QObject(parent), databaseManager(databaseManager), logger("RequestHandler")
+RequestHandler::RequestHandler(QObject *parent)
+    : QObject(parent), logger("RequestHandler")
 {
-    logger.log("RequestHandler Object Created.");
-    accountManager = new AccountManager(databaseManager, this);
+    LOG_DEBUG(logger, "RequestHandler Object Created.");
+    accountManager = new AccountManager(nullptr, this);
     if(accountManager == nullptr)
     {
-        logger.log("Failed to create AccountManager.");
+        LOG_ERROR(logger, "Failed to create AccountManager.");
         return;
     }
-    transactionManager = new TransactionManager(databaseManager, this);
+    transactionManager = new TransactionManager(nullptr, this);
     if(transactionManager == nullptr)
     {
-        logger.log("Failed to create TransactionManager.");
+        LOG_ERROR(logger, "Failed to create TransactionManager.");
         return;
     }
 }
@@ -30,21 +30,51 @@ RequestHandler::~RequestHandler()
         delete accountManager;
         accountManager = nullptr;
     }
-    logger.log("RequestHandler Object Destroyed");
+    LOG_DEBUG(logger, "RequestHandler Object Destroyed");
 }
 
-QByteArray RequestHandler::handleRequest(QByteArray requestData)
+QJsonObject RequestHandler::handleRequest(const QJsonObject &requestJson,
+                                          DatabaseManager* databaseManager,
+                                          qint64 replaySequence)
 {
     QMutexLocker locker(&mutex);
-    // Convert the received data to a JSON document
-    QJsonDocument jsonDoc = QJsonDocument::fromJson(requestData);
 
-    // Convert the JSON document to a JSON object
-    QJsonObject requestJson  = jsonDoc.object();
+    // The managers keep no state between requests, only the leased connection changes
+    accountManager->setDatabaseManager(databaseManager);
+    transactionManager->setDatabaseManager(databaseManager);
 
     // Extract the request ID from the request JSON
     qint16 requestId = requestJson ["requestId"].toInt();
 
+    // Operations that change state are journaled by the commit that applies them,
+    // stamped with their time so a replay writes the same history
+    QJsonObject operationJson = requestJson;
+    if (replaySequence == 0)
+    {
+        // Journal fields are never taken from a client
+        operationJson.remove("journalSequence");
+        operationJson.remove("journalTimestamp");
+    }
+    if (isJournaledRequest(requestId))
+    {
+        operationJson.remove("correlationId");
+        if (replaySequence > 0)
+        {
+            operationJson["journalSequence"] = replaySequence;
+        }
+        else
+        {
+            operationJson["journalTimestamp"] = QDateTime::currentMSecsSinceEpoch();
+        }
+        // A replay applies the hash, the password itself never reaches the journal
+        QJsonObject journalRecord = operationJson;
+        if (journalRecord.contains("passwordHash"))
+        {
+            journalRecord.remove("password");
+        }
+        databaseManager->setJournalRecord(journalRecord);
+    }
+
     // Add the response ID to the response JSON
     QJsonObject responseJson;
 
@@ -52,52 +82,76 @@ QByteArray RequestHandler::handleRequest(QByteArray requestData)
     switch (requestId)
     {
     case 0:
-        responseJson = accountManager->login(requestJson);
+        responseJson = accountManager->login(operationJson);
         break;
     case 1:
-        responseJson = accountManager->getAccountNumber(requestJson);
+        responseJson = accountManager->getAccountNumber(operationJson);
         break;
     case 2:
-        responseJson = accountManager->getAccountBalance(requestJson);
+        responseJson = accountManager->getAccountBalance(operationJson);
         break;
     case 3:
-        responseJson = accountManager->createNewAccount(requestJson);
+        responseJson = accountManager->createNewAccount(operationJson);
         break;
     case 4:
-        responseJson = accountManager->deleteAccount(requestJson);
+        responseJson = accountManager->deleteAccount(operationJson);
         break;
     case 5:
         responseJson = accountManager->viewDatabase();
         break;
     case 6:
-        responseJson = transactionManager->makeTransaction(requestJson);
+        responseJson = transactionManager->makeTransaction(operationJson);
         break;
     case 7:
-        responseJson = transactionManager->makeTransfer(requestJson);
+        responseJson = transactionManager->makeTransfer(operationJson);
         break;
     case 8:
-        responseJson = transactionManager->viewTransactionHistory(requestJson);
+        responseJson = transactionManager->viewTransactionHistory(operationJson);
         break;
     case 9:
-        responseJson = accountManager->updateUserData(requestJson);
+        responseJson = accountManager->updateUserData(operationJson);
         break;
     default:
         // Handle unknown request
-        logger.log("Unknown request");
+        LOG_WARNING(logger, "Unknown request");
         break;
     }
 
+    // Nothing is journaled by a request that failed before its commit
+    databaseManager->setJournalRecord(QJsonObject());
+
     responseJson["responseId"] = requestId;
+    // Echo the correlation ID so the client can match replies to requests in flight
+    responseJson["correlationId"] = requestJson["correlationId"];
 
-    // Convert the response object to a JSON document
-    QJsonDocument jsonResponse(responseJson);
+    // Encoding is left to the connection's MessageCodec
+    return responseJson;
+}
 
-    // Convert the JSON document to a byte array using compact removing white spaces
-    QByteArray responseData = jsonResponse.toJson(QJsonDocument::Compact);
+AccountManager::LoginAttempt RequestHandler::lookupLogin(const QJsonObject &requestJson,
+                                                         DatabaseManager* databaseManager)
+{
+    QMutexLocker locker(&mutex);
+    accountManager->setDatabaseManager(databaseManager);
+    return accountManager->lookupLogin(requestJson);
+}
 
-    // Compress the response data
-    responseData = qCompress(responseData);
+QJsonObject RequestHandler::finishLogin(const QJsonObject &requestJson,
+                                        const AccountManager::LoginAttempt &attempt,
+                                        DatabaseManager* databaseManager)
+{
+    QMutexLocker locker(&mutex);
+    accountManager->setDatabaseManager(databaseManager);
+    QJsonObject responseJson = accountManager->finishLogin(attempt);
 
-    // Return the compressed data
-    return responseData;
+    responseJson["responseId"] = requestJson["requestId"].toInt();
+    responseJson["correlationId"] = requestJson["correlationId"];
+    return responseJson;
+}
+
+bool RequestHandler::isJournaledRequest(int requestId)
+{
+    // createNewAccount, deleteAccount, makeTransaction, makeTransfer, updateUserData
+    return requestId == 3 || requestId == 4 || requestId == 6 ||
+           requestId == 7 || requestId == 9;
 }
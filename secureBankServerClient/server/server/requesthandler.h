@@ -6,6 +6,7 @@
 #include <QJsonDocument>
 #include <QJsonObject>
 #include <QMutex>
+#include <QDateTime>
 
 #include "AccountManager.h"
 #include "TransactionManager.h"
@@ -17,17 +18,29 @@ class RequestHandler : public QObject
     Q_OBJECT
 
 public:
-    RequestHandler(DatabaseManager* databaseManager, QObject *parent = nullptr);
+    // Created once per connection, the database is handed in with every request
+    RequestHandler(QObject *parent = nullptr);
     ~RequestHandler();
 
-    QByteArray handleRequest(QByteArray requestData);
+    // replaySequence is only set by the journal replay, it re-applies a journaled operation
+    QJsonObject handleRequest(const QJsonObject &requestJson, DatabaseManager* databaseManager,
+                              qint64 replaySequence = 0);
+
+    // Login in two steps around the password verification on the hashing pool,
+    // see AccountManager::LoginAttempt
+    AccountManager::LoginAttempt lookupLogin(const QJsonObject &requestJson,
+                                             DatabaseManager* databaseManager);
+    QJsonObject finishLogin(const QJsonObject &requestJson,
+                            const AccountManager::LoginAttempt &attempt,
+                            DatabaseManager* databaseManager);
+
+    // Requests whose effects are recorded in the TransactionJournal
+    static bool isJournaledRequest(int requestId);
 
 private:
     QMutex mutex;
-    QString connectionName;
     AccountManager *accountManager = nullptr;
     TransactionManager *transactionManager = nullptr;
-    DatabaseManager* databaseManager = nullptr;
     Logger logger;
 };
 
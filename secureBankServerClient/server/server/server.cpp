@@ -1,65 +1,120 @@
 #include "Server.h"
 
-Server::Server(QObject *parent)
+Server::Server(QObject *parent, int workerCount)
     : QTcpServer(parent), logger("Server")
 {
-    logger.log("Object Created.");
+    LOG_DEBUG(logger, "Object Created.");
+
+    if (workerCount <= 0)
+    {
+        workerCount = QThread::idealThreadCount();
+    }
+
+    // Start all the workers up front so the accept path never creates or destroys threads
+    for (int i = 0; i < workerCount; ++i)
+    {
+        QThread* workerThread = new QThread();
+        workerThread->setObjectName(QString("Worker-%1").arg(i));
+        // Runs inside the worker, its database connections must be opened there
+        connect(workerThread, &QThread::started, []()
+                {
+                    DatabaseConnectionPool::forCurrentThread()->warmUp();
+                });
+        workerThread->start();
+        workerThreads.append(workerThread);
+        workerLoads.append(0);
+    }
+    LOG_DEBUG(logger, QString("Started %1 worker threads.").arg(workerCount));
+
+    // Report the connection pool and TLS handshake metrics every minute
+    metricsTimer = new QTimer(this);
+    connect(metricsTimer, &QTimer::timeout, this, &Server::logMetrics);
+    metricsTimer->start(60 * 1000);
+
     if (!listen(QHostAddress::Any, 19908))
     {
-        logger.log("Failed to start server: " + errorString());
+        LOG_ERROR(logger, "Failed to start server: " + errorString());
     }
     else
     {
         QString ipAddress = serverAddress().toString();
         quint16 port = serverPort();
-        logger.log("Listening on IP: " + ipAddress + ", Port: " + QString::number(port));
+        LOG_INFO(logger, "Listening on IP: " + ipAddress + ", Port: " + QString::number(port));
     }
 }
 
 Server::~Server()
 {
-    //just to be sure
-    for (auto it = clientThreads.begin(); it != clientThreads.end(); ++it)
+    // Stop accepting before tearing the workers down
+    close();
+
+    // Clients still attached are deleted when their worker finishes
+    for (QThread* workerThread : workerThreads)
     {
-        it.value()->quit();
-        it.value()->wait();
-        delete it.value();
+        workerThread->quit();
+        workerThread->wait();
+        delete workerThread;
     }
-    close();
-    logger.log("All Threads have been closed");
-    logger.log("Object Destroyed.");
+    workerThreads.clear();
+    logMetrics();
+    LOG_DEBUG(logger, "All Threads have been closed");
+    LOG_DEBUG(logger, "Object Destroyed.");
 }
 
 void Server::incomingConnection(qintptr socketDescriptor)
 {
-    QThread* clientThread = new QThread();
-    clientThreads.insert(socketDescriptor, clientThread);
+    int workerIndex = leastLoadedWorker();
+    QThread* workerThread = workerThreads.at(workerIndex);
 
     ClientRunnable* clientRunnable = new ClientRunnable(socketDescriptor);
-    clientRunnable->moveToThread(clientThread);
+    clientRunnable->moveToThread(workerThread);
 
-    connect(clientThread, &QThread::started,
-            clientRunnable, &ClientRunnable::run);
-    connect(clientRunnable, &ClientRunnable::clientDisconnected,
-            this, &Server::handleClientDisconnected);
-    connect(clientRunnable, &ClientRunnable::destroyed,
-            clientThread, &QThread::quit);
+    connect(clientRunnable, &ClientRunnable::clientDisconnected, this,
+            [this, workerIndex](qintptr socketDescriptor)
+            {
+                handleClientDisconnected(socketDescriptor, workerIndex);
+            });
+    // Clean up clients that are still connected when the worker shuts down
+    connect(workerThread, &QThread::finished,
+            clientRunnable, &ClientRunnable::deleteLater);
 
-    clientThread->start();
-    logger.log(QString("Client connected with socket descriptor: %1").
-               arg(socketDescriptor));
-    logger.log(QString("Number of connected clients: %1").
-               arg(clientThreads.size()));
+    workerLoads[workerIndex]++;
+    connectedClients++;
+
+    // Set the client up inside its worker's event loop
+    QMetaObject::invokeMethod(clientRunnable, &ClientRunnable::run, Qt::QueuedConnection);
+
+    LOG_INFO(logger, QString("Client connected with socket descriptor: %1 on %2").
+               arg(socketDescriptor).arg(workerThread->objectName()));
+    LOG_INFO(logger, QString("Number of connected clients: %1").
+               arg(connectedClients));
 }
 
-void Server::handleClientDisconnected(qintptr socketDescriptor)
+int Server::leastLoadedWorker() const
 {
-    clientThreads.value(socketDescriptor)->quit();
-    clientThreads.value(socketDescriptor)->wait();
-    delete clientThreads.value(socketDescriptor);
-    clientThreads.remove(socketDescriptor);
-    logger.log(QString("Client disconnected with socket descriptor: %1").
+    int workerIndex = 0;
+    for (int i = 1; i < workerLoads.size(); ++i)
+    {
+        if (workerLoads.at(i) < workerLoads.at(workerIndex))
+        {
+            workerIndex = i;
+        }
+    }
+    return workerIndex;
+}
+
+void Server::handleClientDisconnected(qintptr socketDescriptor, int workerIndex)
+{
+    workerLoads[workerIndex]--;
+    connectedClients--;
+    LOG_INFO(logger, QString("Client disconnected with socket descriptor: %1").
                arg(socketDescriptor));
-    logger.log(QString("Number of connected clients: %1").
-               arg(clientThreads.size()));
+    LOG_INFO(logger, QString("Number of connected clients: %1").
+               arg(connectedClients));
+}
+
+void Server::logMetrics()
+{
+    LOG_INFO(logger, DatabaseConnectionPool::metricsSummary());
+    LOG_INFO(logger, ClientRunnable::handshakeMetricsSummary());
 }
@@ -3,8 +3,10 @@
 
 #include <QTcpServer>
 #include <QThread>
-#include <QMap>
+#include <QVector>
+#include <QTimer>
 #include "ClientRunnable.h"
+#include "DatabaseConnectionPool.h"
 #include "Logger.h"
 
 class Server : public QTcpServer
@@ -12,18 +14,25 @@ class Server : public QTcpServer
     Q_OBJECT
 
 public:
-    Server(QObject *parent = nullptr);
+    // workerCount <= 0 means one worker per CPU core
+    Server(QObject *parent = nullptr, int workerCount = 0);
     ~Server();
 
 protected:
     void incomingConnection(qintptr socketDescriptor) override;
 
-private slots:
-    void handleClientDisconnected(qintptr socketDescriptor);
-
 private:
-    QMap<qintptr, QThread*> clientThreads;
+    // Fixed pool of worker threads, each one runs an event loop shared by many clients
+    QVector<QThread*> workerThreads;
+    // Number of clients currently assigned to each worker
+    QVector<int> workerLoads;
+    int connectedClients = 0;
+    QTimer *metricsTimer = nullptr;
     Logger logger;
+
+    int leastLoadedWorker() const;
+    void handleClientDisconnected(qintptr socketDescriptor, int workerIndex);
+    void logMetrics();
 };
 
 #endif // SERVER_H
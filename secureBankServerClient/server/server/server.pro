@@ -6,15 +6,39 @@ CONFIG += c++17 cmdline static
 # In order to do so, uncomment the following line.
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
+# The online backup calls the SQLite backup API on the driver's handle, so Qt must use
+# the same SQLite library (configure Qt with -system-sqlite).
+LIBS += -lsqlite3
+
+# Whether a TLS session was resumed is read from the OpenSSL handle of each socket,
+# so this must be the OpenSSL library Qt's TLS backend uses.
+LIBS += -lssl
+
+# Lowest log level compiled in: 0 = debug, 1 = info, 2 = warning, 3 = error.
+# Uncomment to drop every debug message from release builds.
+#DEFINES += LOG_COMPILE_MIN_LEVEL=1
+
 SOURCES += \
         accountmanager.cpp \
+        backupchunkstore.cpp \
+        backupengine.cpp \
         backupmanager.cpp \
+        balancecache.cpp \
         clientrunnable.cpp \
+        databaseconnectionpool.cpp \
         databasemanager.cpp \
+        journalreplay.cpp \
         logger.cpp \
+        logincache.cpp \
+        logsink.cpp \
         main.cpp \
+        messagecodec.cpp \
+        messageframer.cpp \
+        money.cpp \
+        passwordhasher.cpp \
         requesthandler.cpp \
         server.cpp \
+        transactionjournal.cpp \
         transactionmanager.cpp
 
 # Default rules for deployment.
@@ -24,10 +48,22 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 
 HEADERS += \
     accountmanager.h \
+    backupchunkstore.h \
+    backupengine.h \
     backupmanager.h \
+    balancecache.h \
     clientrunnable.h \
+    databaseconnectionpool.h \
     databasemanager.h \
+    journalreplay.h \
     logger.h \
+    logincache.h \
+    logsink.h \
+    messagecodec.h \
+    messageframer.h \
+    money.h \
+    passwordhasher.h \
     requesthandler.h \
     server.h \
+    transactionjournal.h \
     transactionmanager.h
@@ -0,0 +1,271 @@
+#include "TransactionJournal.h"
+
+#ifdef Q_OS_WIN
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+// Length of the CBOR payload, checksum of the payload, sequence number
+#define RECORD_HEADER_SIZE 14
+
+TransactionJournal *TransactionJournal::instance()
+{
+    static TransactionJournal *journal = new TransactionJournal();
+    return journal;
+}
+
+TransactionJournal::TransactionJournal()
+    : logger("TransactionJournal")
+{}
+
+TransactionJournal::~TransactionJournal()
+{
+    stop();
+}
+
+bool TransactionJournal::start(const Options &options)
+{
+    QMutexLocker locker(&mutex);
+    if (running)
+    {
+        return true;
+    }
+
+    this->options = options;
+    QDir dir;
+    if (!dir.exists(options.directory))
+    {
+        dir.mkpath(options.directory);
+    }
+    if (!openSegment())
+    {
+        return false;
+    }
+
+    running = true;
+    writerThread = QThread::create([this]() { writerLoop(); });
+    writerThread->setObjectName("JournalWriter");
+    writerThread->start(QThread::HighPriority);
+    return true;
+}
+
+void TransactionJournal::stop()
+{
+    {
+        QMutexLocker locker(&mutex);
+        if (!running)
+        {
+            return;
+        }
+        running = false;
+        recordsPending.wakeAll();
+    }
+
+    writerThread->wait();
+    delete writerThread;
+    writerThread = nullptr;
+    segmentFile.close();
+}
+
+bool TransactionJournal::isRunning()
+{
+    QMutexLocker locker(&mutex);
+    return running;
+}
+
+bool TransactionJournal::hasFailed()
+{
+    QMutexLocker locker(&mutex);
+    return failed;
+}
+
+QString TransactionJournal::directory()
+{
+    QMutexLocker locker(&mutex);
+    return options.directory;
+}
+
+bool TransactionJournal::append(qint64 sequence, const QJsonObject &record)
+{
+    // Encoded outside the lock, committing threads only contend for the memcpy
+    QByteArray encodedRecord = encodeRecord(sequence, record);
+
+    QMutexLocker locker(&mutex);
+    if (!running)
+    {
+        return true;
+    }
+    if (failed)
+    {
+        return false;
+    }
+
+    pendingRecords.append(encodedRecord);
+    qint64 ticket = ++appendedCount;
+    recordsPending.wakeOne();
+
+    if (options.waitForSync)
+    {
+        // The writer never counts a failed batch as synced
+        while (syncedCount < ticket && !failed)
+        {
+            recordsSynced.wait(&mutex);
+        }
+        return syncedCount >= ticket;
+    }
+    return true;
+}
+
+void TransactionJournal::rotate()
+{
+    QMutexLocker locker(&mutex);
+    if (running)
+    {
+        rotateRequested = true;
+        recordsPending.wakeOne();
+    }
+}
+
+void TransactionJournal::writerLoop()
+{
+    QByteArray batch;
+    QMutexLocker locker(&mutex);
+
+    while (true)
+    {
+        while (running && pendingRecords.isEmpty() && !rotateRequested)
+        {
+            recordsPending.wait(&mutex);
+        }
+        if (!running && pendingRecords.isEmpty())
+        {
+            break;
+        }
+
+        // Everything appended while the previous fsync ran shares this one
+        batch.swap(pendingRecords);
+        qint64 batchCount = appendedCount;
+        bool rotateNow = rotateRequested;
+        rotateRequested = false;
+        bool success = !failed;
+        locker.unlock();
+
+        // Once a write failed the segment may end in a torn record, nothing after it
+        // could be read back, so later batches are dropped and their committers told
+        if (success && !batch.isEmpty())
+        {
+            if (segmentFile.write(batch) != batch.size() || !syncSegment())
+            {
+                LOG_ERROR(logger, "Failed to write the transaction journal: " + segmentFile.errorString());
+                success = false;
+            }
+        }
+        batch.resize(0);
+        if (success && rotateNow)
+        {
+            segmentFile.close();
+            success = openSegment();
+        }
+
+        locker.relock();
+        if (success)
+        {
+            syncedCount = batchCount;
+        }
+        else if (!failed)
+        {
+            LOG_ERROR(logger, "The transaction journal failed, operations are no longer accepted.");
+            failed = true;
+        }
+        recordsSynced.wakeAll();
+    }
+}
+
+bool TransactionJournal::openSegment()
+{
+    QString segmentName = QString("%1/journal_%2.log").
+                          arg(options.directory,
+                              QDateTime::currentDateTime().toString("yyyyMMddHHmmsszzz"));
+    segmentFile.setFileName(segmentName);
+    if (!segmentFile.open(QIODevice::WriteOnly | QIODevice::Append))
+    {
+        LOG_ERROR(logger, "Failed to open journal segment: " + segmentName);
+        return false;
+    }
+    return true;
+}
+
+bool TransactionJournal::syncSegment()
+{
+    if (!segmentFile.flush())
+    {
+        return false;
+    }
+#ifdef Q_OS_WIN
+    return _commit(segmentFile.handle()) == 0;
+#else
+    return ::fsync(segmentFile.handle()) == 0;
+#endif
+}
+
+QByteArray TransactionJournal::encodeRecord(qint64 sequence, const QJsonObject &record)
+{
+    QByteArray payload = QCborValue::fromJsonValue(record).toCbor();
+
+    QByteArray encodedRecord(RECORD_HEADER_SIZE, Qt::Uninitialized);
+    uchar *header = reinterpret_cast<uchar *>(encodedRecord.data());
+    qToBigEndian<quint32>(quint32(payload.size()), header);
+    qToBigEndian<quint16>(qChecksum(payload), header + 4);
+    qToBigEndian<qint64>(sequence, header + 6);
+    encodedRecord.append(payload);
+    return encodedRecord;
+}
+
+QList<TransactionJournal::Entry> TransactionJournal::readAll(const QString &directory)
+{
+    Logger logger("TransactionJournal");
+    QList<Entry> entries;
+    QDir dir(directory);
+    const QStringList segments = dir.entryList(QStringList() << "journal_*.log",
+                                               QDir::Files, QDir::Name);
+
+    for (const QString &segment : segments)
+    {
+        QFile segmentFile(dir.filePath(segment));
+        if (!segmentFile.open(QIODevice::ReadOnly))
+        {
+            LOG_ERROR(logger, "Failed to open journal segment: " + segment);
+            continue;
+        }
+        QByteArray data = segmentFile.readAll();
+        const uchar *bytes = reinterpret_cast<const uchar *>(data.constData());
+
+        qsizetype offset = 0;
+        while (data.size() - offset >= RECORD_HEADER_SIZE)
+        {
+            quint32 payloadSize = qFromBigEndian<quint32>(bytes + offset);
+            quint16 checksum = qFromBigEndian<quint16>(bytes + offset + 4);
+            qint64 sequence = qFromBigEndian<qint64>(bytes + offset + 6);
+
+            // A crash while appending leaves a torn record at the end
+            if (data.size() - offset - RECORD_HEADER_SIZE < qsizetype(payloadSize))
+            {
+                break;
+            }
+            QByteArrayView payload(data.constData() + offset + RECORD_HEADER_SIZE, payloadSize);
+            if (qChecksum(payload) != checksum)
+            {
+                LOG_WARNING(logger, "Corrupt record in journal segment: " + segment);
+                break;
+            }
+
+            Entry entry;
+            entry.sequence = sequence;
+            entry.record = QCborValue::fromCbor(payload.toByteArray()).toMap().toJsonObject();
+            entries.append(entry);
+            offset += RECORD_HEADER_SIZE + payloadSize;
+        }
+    }
+    return entries;
+}
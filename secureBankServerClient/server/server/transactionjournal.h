@@ -0,0 +1,87 @@
+#ifndef TRANSACTIONJOURNAL_H
+#define TRANSACTIONJOURNAL_H
+
+#include <QString>
+#include <QByteArray>
+#include <QList>
+#include <QJsonObject>
+#include <QCborValue>
+#include <QCborMap>
+#include <QFile>
+#include <QDir>
+#include <QDateTime>
+#include <QThread>
+#include <QMutex>
+#include <QWaitCondition>
+#include <QtEndian>
+
+#include "Logger.h"
+
+// Append-only journal of committed operations, the part of the history that is
+// newer than the latest backup. Every record holds the operation's request and
+// the sequence number it committed with. Records are group committed: the writer
+// thread syncs whatever has accumulated with a single fsync. A failed write or
+// rotation leaves the journal failed for good, later appends are refused.
+class TransactionJournal
+{
+public:
+    struct Options
+    {
+        QString directory = "journal";
+        // Block the committing request until its record is on disk
+        bool waitForSync = true;
+    };
+
+    struct Entry
+    {
+        qint64 sequence;
+        QJsonObject record;
+    };
+
+    static TransactionJournal *instance();
+
+    bool start(const Options &options);
+    // Writes and syncs every pending record and joins the writer
+    void stop();
+    bool isRunning();
+    // A record could not be written, nothing is journaled any more
+    bool hasFailed();
+    QString directory();
+
+    // Called right after the commit that took this sequence number. Returns false when
+    // the record did not reach the disk, or with waitForSync off when the journal failed.
+    bool append(qint64 sequence, const QJsonObject &record);
+    // The next records go to a new segment, called after every backup
+    void rotate();
+
+    // Every intact record of every segment in the directory, in file order.
+    // A segment is read up to its first torn or corrupt record.
+    static QList<Entry> readAll(const QString &directory);
+
+private:
+    TransactionJournal();
+    ~TransactionJournal();
+
+    void writerLoop();
+    bool openSegment();
+    bool syncSegment();
+
+    static QByteArray encodeRecord(qint64 sequence, const QJsonObject &record);
+
+    QMutex mutex;
+    QWaitCondition recordsPending;
+    QWaitCondition recordsSynced;
+    QByteArray pendingRecords;
+    qint64 appendedCount = 0;
+    qint64 syncedCount = 0;
+    bool running = false;
+    bool rotateRequested = false;
+    bool failed = false;
+
+    QThread *writerThread = nullptr;
+    QFile segmentFile;
+    Options options;
+    Logger logger;
+};
+
+#endif // TRANSACTIONJOURNAL_H
@@ -1,14 +1,29 @@
 #include "transactionmanager.h"
 
+// Replayed operations keep the time they were first committed at
+static QDateTime operationTime(const QJsonObject &requestJson)
+{
+    if (requestJson.contains("journalTimestamp"))
+    {
+        return QDateTime::fromMSecsSinceEpoch(requestJson["journalTimestamp"].toInteger());
+    }
+    return QDateTime::currentDateTime();
+}
+
 TransactionManager::TransactionManager(DatabaseManager* databaseManager, QObject *parent)
     : QObject(parent), databaseManager(databaseManager), logger("TransactionManager")
 {
-    logger.log("TransactionManager Object Created.");
+    LOG_DEBUG(logger, "TransactionManager Object Created.");
 }
 
 TransactionManager::~TransactionManager()
 {
-    logger.log("TransactionManager Object Destroyed");
+    LOG_DEBUG(logger, "TransactionManager Object Destroyed");
+}
+
+void TransactionManager::setDatabaseManager(DatabaseManager* databaseManager)
+{
+    this->databaseManager = databaseManager;
 }
 
 QJsonObject TransactionManager::makeTransaction(QJsonObject requestJson)
@@ -18,44 +33,42 @@ QJsonObject TransactionManager::makeTransaction(QJsonObject requestJson)
 
     // Extract the necessary data from the request JSON
     qint64 accountNumber = requestJson["accountNumber"].toVariant().toLongLong();
-    double amount = requestJson["amount"].toDouble();
+    bool amountValid;
+    Money amount = Money::fromJson(requestJson["amount"], &amountValid);
+    if (!amountValid)
+    {
+        responseJson["errorMessage"] = "Invalid amount.";
+        return responseJson;
+    }
 
-    // Prepare the search criteria
-    QJsonObject searchCriteria;
-    searchCriteria["AccountNumber"] = accountNumber;
+    // The cached balance is replaced once the new one is committed
+    BalanceWriteScope balanceWrite(accountNumber);
 
-    // Start a transaction
-    if (!databaseManager->startDatabaseTransaction())
+    // Take the write lock up front, the balance check and update are one statement
+    if (!databaseManager->startImmediateTransaction())
     {
         responseJson["errorMessage"] = "Failed to start transaction.";
         return responseJson;
     }
 
-    // Fetch the current balance
-    QVariant currentBalance = databaseManager->fetchData("Users_Personal_Data", "Balance",
-                                        searchCriteria);
-
-    // Check if the balance is sufficient
-    if (currentBalance.toDouble() < 0 || currentBalance.toDouble() + amount < 0)
+    bool applied;
+    Money newBalance;
+    if (!adjustBalance(accountNumber, amount, &applied, &newBalance))
     {
-        responseJson["errorMessage"] = "Insufficient balance";
+        responseJson["errorMessage"] = "Failed to update Balance";
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
-
-    // Update the balance
-    QJsonObject balanceData;
-    balanceData["Balance"] = currentBalance.toDouble() + amount;
-
-    if (!databaseManager->updateData("Users_Personal_Data", balanceData, searchCriteria))
+    if (!applied)
     {
-        responseJson["errorMessage"] = "Failed to update Balance";
+        responseJson["errorMessage"] = accountExists(accountNumber) ? "Insufficient balance"
+                                                                    : "Account not found.";
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
 
     // Log the transaction
-    if (!logTransaction(accountNumber, amount))
+    if (!logTransaction(accountNumber, amount, operationTime(requestJson)))
     {
         responseJson["errorMessage"] = "Failed to log Transaction";
         databaseManager->rollbackDatabaseTransaction();
@@ -65,20 +78,18 @@ QJsonObject TransactionManager::makeTransaction(QJsonObject requestJson)
     // Commit the transaction
     if (!databaseManager->commitDatabaseTransaction())
     {
-        logger.log("Failed to commit transaction for makeTransaction.");
+        LOG_ERROR(logger, "Failed to commit transaction for makeTransaction.");
         if (!databaseManager->rollbackDatabaseTransaction())
         {
-            logger.log("Failed to rollback transaction for makeTransaction.");
+            LOG_ERROR(logger, "Failed to rollback transaction for makeTransaction.");
         }
         responseJson["errorMessage"] = "Failed to commit Transaction";
         return responseJson;
     }
 
+    balanceWrite.committed(newBalance);
     responseJson["transactionSuccess"] = true;
-
-    // Fetch the updated balance from the database
-    responseJson["newBalance"] =
-        databaseManager->fetchData("Users_Personal_Data", "Balance", searchCriteria).toDouble();
+    responseJson["newBalance"] = newBalance.toJson();
     return responseJson;
 }
 
@@ -90,7 +101,15 @@ QJsonObject TransactionManager::makeTransfer(QJsonObject requestJson)
     // Extract the necessary data from the request JSON
     qint64 fromAccountNumber = requestJson["fromAccountNumber"].toVariant().toLongLong();
     qint64 toAccountNumber = requestJson["toAccountNumber"].toVariant().toLongLong();
-    double amount = requestJson["amount"].toDouble();
+    bool amountValid;
+    Money amount = Money::fromJson(requestJson["amount"], &amountValid);
+
+    // A negative transfer would take money from the receiver
+    if (!amountValid || amount <= Money())
+    {
+        responseJson["errorMessage"] = "Invalid amount.";
+        return responseJson;
+    }
 
     // Check if the 'from' and 'to' account numbers are the same
     if (fromAccountNumber == toAccountNumber)
@@ -99,57 +118,52 @@ QJsonObject TransactionManager::makeTransfer(QJsonObject requestJson)
         return responseJson;
     }
 
-    // Prepare the search criteria
-    QJsonObject fromSearchCriteria;
-    fromSearchCriteria["AccountNumber"] = fromAccountNumber;
-    QJsonObject toSearchCriteria;
-    toSearchCriteria["AccountNumber"] = toAccountNumber;
+    BalanceWriteScope fromBalanceWrite(fromAccountNumber);
+    BalanceWriteScope toBalanceWrite(toAccountNumber);
 
-    // Start a transaction
-    if (!databaseManager->startDatabaseTransaction())
+    // Take the write lock up front, the transfer is two conditional updates and two inserts
+    if (!databaseManager->startImmediateTransaction())
     {
         responseJson["errorMessage"] = "failed";
         return responseJson;
     }
 
-    // Fetch the 'from' account balance
-    QVariant fromBalance = databaseManager->fetchData("Users_Personal_Data", "Balance", fromSearchCriteria);
-
-    // Check if the 'from' account has sufficient balance
-    if (fromBalance.toDouble() < amount)
+    // Debit first, it only applies when the 'from' balance covers the amount
+    bool fromApplied;
+    Money newFromBalance;
+    if (!adjustBalance(fromAccountNumber, -amount, &fromApplied, &newFromBalance))
     {
-        responseJson["errorMessage"] = "Insufficient balance";
+        responseJson["errorMessage"] = "Failed to update transaction rolling back";
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
-
-    // Fetch the 'to' account balance
-    QVariant toBalance = databaseManager->fetchData("Users_Personal_Data", "Balance", toSearchCriteria);
-
-    // Check if the 'to' account exists
-    if (!toBalance.isValid())
+    if (!fromApplied)
     {
-        responseJson["errorMessage"] = "The 'to' account does not exist";
+        responseJson["errorMessage"] = "Insufficient balance";
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
 
-    // Update the 'from' and 'to' account balances
-    QJsonObject fromBalanceData, toBalanceData;
-    fromBalanceData["Balance"] = fromBalance.toDouble() - amount;
-    toBalanceData["Balance"] = toBalance.toDouble() + amount;
-
-    if (!databaseManager->updateData("Users_Personal_Data", fromBalanceData, fromSearchCriteria)
-        || !databaseManager->updateData("Users_Personal_Data", toBalanceData, toSearchCriteria))
+    // No row updated means the 'to' account does not exist
+    bool toApplied;
+    Money newToBalance;
+    if (!adjustBalance(toAccountNumber, amount, &toApplied, &newToBalance))
     {
         responseJson["errorMessage"] = "Failed to update transaction rolling back";
         databaseManager->rollbackDatabaseTransaction();
         return responseJson;
     }
+    if (!toApplied)
+    {
+        responseJson["errorMessage"] = "The 'to' account does not exist";
+        databaseManager->rollbackDatabaseTransaction();
+        return responseJson;
+    }
 
     // Log the transfer in the Transaction_History table for both 'from' and 'to' accounts
-    if (!logTransaction(fromAccountNumber, -amount) ||
-        !logTransaction(toAccountNumber, amount))
+    QDateTime transferTime = operationTime(requestJson);
+    if (!logTransaction(fromAccountNumber, -amount, transferTime) ||
+        !logTransaction(toAccountNumber, amount, transferTime))
     {
         responseJson["errorMessage"] = "Failed to log transaction rolling back";
         databaseManager->rollbackDatabaseTransaction();
@@ -159,24 +173,64 @@ QJsonObject TransactionManager::makeTransfer(QJsonObject requestJson)
     // Commit the transaction
     if (!databaseManager->commitDatabaseTransaction())
     {
-        logger.log("Failed to commit transaction for makeTransfer.");
+        LOG_ERROR(logger, "Failed to commit transaction for makeTransfer.");
         if (!databaseManager->rollbackDatabaseTransaction())
         {
-            logger.log("Failed to rollback transaction for makeTransfer.");
+            LOG_ERROR(logger, "Failed to rollback transaction for makeTransfer.");
         }
         responseJson["errorMessage"] = "Failed to rollback transaction for makeTransfer.";
         return responseJson;
     }
 
+    fromBalanceWrite.committed(newFromBalance);
+    toBalanceWrite.committed(newToBalance);
     responseJson["transferSuccess"] = true;
 
-    // Fetch the updated 'from' and 'to' account balances from the database
-    responseJson["newFromBalance"] =
-        databaseManager->fetchData("Users_Personal_Data", "Balance", fromSearchCriteria).toDouble();
-    responseJson["newToBalance"] =
-        databaseManager->fetchData("Users_Personal_Data", "Balance", toSearchCriteria).toDouble();
+    // Balances as of the commit, returned by the updates themselves
+    responseJson["newFromBalance"] = newFromBalance.toJson();
+    responseJson["newToBalance"] = newToBalance.toJson();
     return responseJson;
+}
+
+bool TransactionManager::adjustBalance(qint64 accountNumber, const Money &amount,
+                                       bool *applied, Money *newBalance)
+{
+    *applied = false;
+
+    // Check and update in one statement, no window between reading and writing the balance
+    QSqlQuery *adjustBalanceQuery = databaseManager->preparedQuery
+        ("UPDATE Users_Personal_Data SET Balance = Balance + ?"
+         " WHERE AccountNumber = ? AND Balance + ? >= 0 RETURNING Balance");
+    if (adjustBalanceQuery == nullptr)
+    {
+        return false;
+    }
+    adjustBalanceQuery->bindValue(0, amount.toMinorUnits());
+    adjustBalanceQuery->bindValue(1, accountNumber);
+    adjustBalanceQuery->bindValue(2, amount.toMinorUnits());
+
+    if (!adjustBalanceQuery->exec())
+    {
+        LOG_ERROR(logger, "Failed to update balance.");
+        LOG_ERROR(logger, "Error: " + adjustBalanceQuery->lastError().text());
+        adjustBalanceQuery->finish();
+        return false;
+    }
+
+    if (adjustBalanceQuery->next())
+    {
+        *applied = true;
+        *newBalance = Money::fromVariant(adjustBalanceQuery->value(0));
+    }
+    adjustBalanceQuery->finish();
+    return true;
+}
 
+bool TransactionManager::accountExists(qint64 accountNumber)
+{
+    QJsonObject searchCriteria;
+    searchCriteria["AccountNumber"] = accountNumber;
+    return databaseManager->fetchData("Users_Personal_Data", "COUNT(*)", searchCriteria).toInt() > 0;
 }
 
 QJsonObject TransactionManager::viewTransactionHistory(QJsonObject requestJson)
@@ -187,46 +241,51 @@ QJsonObject TransactionManager::viewTransactionHistory(QJsonObject requestJson)
     // Extract the account number from the request JSON
     qint64 accountNumber = requestJson["accountNumber"].toVariant().toLongLong();
 
-    // Use the DatabaseManager pointer to get the QSqlDatabase object
-    QSqlDatabase dbConnection = databaseManager->getDatabase();
-    QSqlQuery transactionHistoryQuery(dbConnection);
-    transactionHistoryQuery.prepare
+    // Use the connection's cached prepared statement
+    QSqlQuery *transactionHistoryQuery = databaseManager->preparedQuery
         ("SELECT TransactionID, Date, Time, Amount FROM Transaction_History "
-         "WHERE AccountNumber = :accountNumber ORDER BY Date DESC, Time DESC");
-    transactionHistoryQuery.bindValue(":accountNumber", accountNumber);
+         "WHERE AccountNumber = :accountNumber ORDER BY Timestamp DESC, TransactionID DESC");
+    if (transactionHistoryQuery == nullptr)
+    {
+        responseJson["errorMessage"] = "Database query preparation failed.";
+        return responseJson;
+    }
+    transactionHistoryQuery->bindValue(":accountNumber", accountNumber);
 
-    if (!transactionHistoryQuery.exec())
+    if (!transactionHistoryQuery->exec())
     {
         responseJson["errorMessage"] = "Database query execution failed.";
-        logger.log("Failed to fetch transaction history.");
-        logger.log("Error: " + transactionHistoryQuery.lastError().text());
+        LOG_ERROR(logger, "Failed to fetch transaction history.");
+        LOG_ERROR(logger, "Error: " + transactionHistoryQuery->lastError().text());
+        transactionHistoryQuery->finish();
         return responseJson;
     }
 
     // Create a JSON array to store transaction history
     QJsonArray transactionHistoryArray;
 
-    while (transactionHistoryQuery.next())
+    while (transactionHistoryQuery->next())
     {
         QJsonObject transactionObj;
-        transactionObj["TransactionID"] = transactionHistoryQuery.
+        transactionObj["TransactionID"] = transactionHistoryQuery->
                                           value("TransactionID").toLongLong();
-        transactionObj["Date"] = transactionHistoryQuery.
+        transactionObj["Date"] = transactionHistoryQuery->
                                  value("Date").toString();
-        transactionObj["Time"] = transactionHistoryQuery.
+        transactionObj["Time"] = transactionHistoryQuery->
                                  value("Time").toString();
-        transactionObj["Amount"] = transactionHistoryQuery.
-                                   value("Amount").toDouble();
+        transactionObj["Amount"] = Money::fromVariant(transactionHistoryQuery->
+                                                      value("Amount")).toJson();
 
         transactionHistoryArray.append(transactionObj);
     }
+    transactionHistoryQuery->finish();
 
     // Check if any data was fetched
     if (transactionHistoryArray.isEmpty())
     {
         responseJson["errorMessage"] =
             "No transaction history found for the given account number.";
-        logger.log("No transaction history found for account number: "
+        LOG_INFO(logger, "No transaction history found for account number: "
                    + QString::number(accountNumber));
         return responseJson;
     }
@@ -237,19 +296,19 @@ QJsonObject TransactionManager::viewTransactionHistory(QJsonObject requestJson)
     return responseJson;
 }
 
-bool TransactionManager::logTransaction(qint64 accountNumber, double amount)
+bool TransactionManager::logTransaction(qint64 accountNumber, const Money &amount,
+                                        const QDateTime &transactionTime)
 {
-    // Get the current date and time
-    QDateTime currentDateTime = QDateTime::currentDateTime();
-    QString formattedDate = currentDateTime.toString("dd-MM-yyyy");
-    QString formattedTime = currentDateTime.toString("hh:mm:ss");
+    QString formattedDate = transactionTime.toString("dd-MM-yyyy");
+    QString formattedTime = transactionTime.toString("hh:mm:ss");
 
     // Prepare the transaction data
     QJsonObject transactionData;
     transactionData["AccountNumber"] = accountNumber;
     transactionData["Date"] = formattedDate;
     transactionData["Time"] = formattedTime;
-    transactionData["Amount"] = amount;
+    transactionData["Amount"] = amount.toMinorUnits();
+    transactionData["Timestamp"] = transactionTime.toSecsSinceEpoch();
 
     // Log the transaction in the database
     bool success = databaseManager->insertData("Transaction_History", transactionData);